@@ -0,0 +1,527 @@
+#include "ChunkedWorld.h"
+#include "TileStreaming.h"
+
+#include "utilities/ArrayMacros.h"
+#include "utilities/FileHandling.h"
+#include "utilities/Logging.h"
+#include "utilities/RunLength.h"
+#include "utilities/StringManipulation.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+// World files start with a WorldFileHeader, followed by an index with a
+// WorldFileChunk for every chunk in row order, then the chunk data. Each
+// chunk holds its tile plane followed by its attribute plane, stored either
+// raw or run-length encoded. Chunks at the right and bottom edges are padded
+// out to the full chunk size with blank tiles.
+
+#define WORLD_FILE_MAGIC   0x57474E4D // "MNGW"
+#define WORLD_FILE_VERSION 1
+
+#define WORLD_CHUNK_RAW        0
+#define WORLD_CHUNK_RUN_LENGTH 1
+
+#define CHUNK_TILES (WORLD_CHUNK_DIMENSION * WORLD_CHUNK_DIMENSION)
+
+// Chunks within this many tiles of the streamed window are loaded ahead of
+// time, so they're usually in by the time the window reaches them. The 32x32
+// window touches at most 2x2 chunks and the widened area at most 3x3, so the
+// cache can't usefully be any smaller than that.
+#define PREFETCH_MARGIN (WORLD_CHUNK_DIMENSION / 2)
+#define MIN_CACHE_SLOTS 9
+
+struct WorldFileHeader
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t chunk_dimension;
+	uint16_t columns;
+	uint16_t rows;
+	uint16_t chunk_columns;
+	uint16_t chunk_rows;
+};
+
+struct WorldFileChunk
+{
+	uint32_t offset; // from the start of the file
+	uint32_t stored_size;
+	uint32_t method;
+};
+
+enum SlotState
+{
+	SLOT_EMPTY,
+	SLOT_LOADING,
+	SLOT_READY,
+};
+
+struct ChunkSlot
+{
+	// Only the main thread changes which chunk a slot is for, and the loading
+	// thread only touches a slot's planes while it's in the loading state.
+	std::atomic<int> state;
+	int chunk_x, chunk_y;
+	unsigned last_used;
+
+	byte_t planes[2 * CHUNK_TILES]; // tiles, then attributes
+};
+
+struct ChunkedWorld
+{
+	file_handle_t file;
+	WorldFileHeader header;
+	WorldFileChunk* index;
+	byte_t* read_buffer;
+
+	ChunkSlot* slots;
+	int slot_count;
+	unsigned frame;
+
+	TileStream stream;
+
+	std::thread loader;
+	std::mutex mutex;
+	std::condition_variable requests_ready;
+	bool quit;
+
+	// Both queues hold slot numbers. Requests never hold more than every slot.
+	// A slot is given a new chunk at most once a frame, so between drains it
+	// can be finished twice: once for the chunk it had, once for the new one.
+	int* requests;
+	int request_first, request_count;
+	int* finished;
+	int finished_count;
+};
+
+static inline int floor_divide(int value, int divisor)
+{
+	int quotient = value / divisor;
+	return (value % divisor < 0) ? quotient - 1 : quotient;
+}
+
+static bool read_chunk(ChunkedWorld* world, ChunkSlot& slot)
+{
+	const WorldFileChunk& chunk = world->index[slot.chunk_y * world->header.chunk_columns + slot.chunk_x];
+
+	// the index was checked on opening, but the read buffer is only so big
+	if(chunk.stored_size > run_length_bound(2 * CHUNK_TILES)) return false;
+
+	size_t read = read_file_stream(world->file, chunk.offset, world->read_buffer, chunk.stored_size);
+	if(read != chunk.stored_size) return false;
+
+	switch(chunk.method)
+	{
+		case WORLD_CHUNK_RAW:
+		{
+			if(chunk.stored_size != sizeof slot.planes) return false;
+			COPY(world->read_buffer, slot.planes, sizeof slot.planes);
+			return true;
+		}
+		case WORLD_CHUNK_RUN_LENGTH:
+		{
+			size_t decoded = run_length_decode(world->read_buffer, chunk.stored_size, slot.planes, sizeof slot.planes);
+			return decoded == sizeof slot.planes;
+		}
+	}
+	return false;
+}
+
+static void loader_main(ChunkedWorld* world)
+{
+	for(;;)
+	{
+		int slot_index;
+		{
+			std::unique_lock<std::mutex> lock(world->mutex);
+			while(!world->quit && world->request_count == 0)
+				world->requests_ready.wait(lock);
+
+			if(world->quit) return;
+
+			slot_index = world->requests[world->request_first];
+			world->request_first = (world->request_first + 1) % world->slot_count;
+			world->request_count -= 1;
+		}
+
+		ChunkSlot& slot = world->slots[slot_index];
+		if(!read_chunk(world, slot))
+		{
+			// a chunk that can't be read is shown blank rather than retried forever
+			LOG_ISSUE("couldn't read world chunk %i, %i", slot.chunk_x, slot.chunk_y);
+			CLEAR_ARRAY(slot.planes);
+		}
+		slot.state.store(SLOT_READY);
+
+		std::lock_guard<std::mutex> lock(world->mutex);
+		world->finished[world->finished_count] = slot_index;
+		world->finished_count += 1;
+	}
+}
+
+static const ChunkSlot* find_ready_chunk(const ChunkedWorld* world, int chunk_x, int chunk_y)
+{
+	for(int i = 0; i < world->slot_count; ++i)
+	{
+		const ChunkSlot& slot = world->slots[i];
+		if(slot.chunk_x == chunk_x && slot.chunk_y == chunk_y && slot.state.load() == SLOT_READY)
+			return &slot;
+	}
+	return nullptr;
+}
+
+static void fetch_from_chunks(const void* data, int x, int y, byte_t& tile, byte_t& attribute)
+{
+	const ChunkedWorld* world = static_cast<const ChunkedWorld*>(data);
+
+	tile = 0;
+	attribute = 0;
+	if(x < 0 || x >= world->header.columns || y < 0 || y >= world->header.rows)
+		return;
+
+	const ChunkSlot* slot = find_ready_chunk(world, x / WORLD_CHUNK_DIMENSION, y / WORLD_CHUNK_DIMENSION);
+	if(slot == nullptr)
+		return;
+
+	int index = (y % WORLD_CHUNK_DIMENSION) * WORLD_CHUNK_DIMENSION + (x % WORLD_CHUNK_DIMENSION);
+	tile = slot->planes[index];
+	attribute = slot->planes[CHUNK_TILES + index];
+}
+
+ChunkedWorld* open_chunked_world(const char* filename, int cache_slots)
+{
+	char path[128];
+	concatenate("resources/tilemaps/", filename, path);
+
+	file_handle_t file = open_file_stream(path);
+	if(!is_file_stream_open(file))
+	{
+		LOG_ISSUE("couldn't open world file: %s", path);
+		return nullptr;
+	}
+
+	WorldFileHeader header;
+	size_t read = read_file_stream(file, 0, &header, sizeof header);
+	if(read != sizeof header || header.magic != WORLD_FILE_MAGIC || header.version != WORLD_FILE_VERSION
+		|| header.chunk_dimension != WORLD_CHUNK_DIMENSION)
+	{
+		LOG_ISSUE("world file has an unknown format or version: %s", path);
+		close_file_stream(file);
+		return nullptr;
+	}
+
+	// the chunk grid has to be exactly what covers the map
+	int chunk_columns = (header.columns + WORLD_CHUNK_DIMENSION - 1) / WORLD_CHUNK_DIMENSION;
+	int chunk_rows = (header.rows + WORLD_CHUNK_DIMENSION - 1) / WORLD_CHUNK_DIMENSION;
+	if(chunk_columns == 0 || chunk_rows == 0 || header.chunk_columns != chunk_columns || header.chunk_rows != chunk_rows)
+	{
+		LOG_ISSUE("world file has a chunk grid that doesn't match its size: %s", path);
+		close_file_stream(file);
+		return nullptr;
+	}
+
+	int chunk_count = chunk_columns * chunk_rows;
+	WorldFileChunk* index = new WorldFileChunk[chunk_count];
+	read = read_file_stream(file, sizeof header, index, sizeof(WorldFileChunk) * chunk_count);
+	if(read != sizeof(WorldFileChunk) * chunk_count)
+	{
+		LOG_ISSUE("world file has a truncated chunk index: %s", path);
+		delete[] index;
+		close_file_stream(file);
+		return nullptr;
+	}
+
+	// Every chunk has to lie within the file and fit the read buffer, which
+	// is as big as a chunk can get once encoded.
+	unsigned long long file_size = file_stream_size(file);
+	for(int i = 0; i < chunk_count; ++i)
+	{
+		const WorldFileChunk& chunk = index[i];
+		unsigned long long end = static_cast<unsigned long long>(chunk.offset) + chunk.stored_size;
+		if(chunk.stored_size > run_length_bound(2 * CHUNK_TILES) || end > file_size)
+		{
+			LOG_ISSUE("world file has a bad chunk index entry %i: %s", i, path);
+			delete[] index;
+			close_file_stream(file);
+			return nullptr;
+		}
+	}
+
+	if(cache_slots < MIN_CACHE_SLOTS)
+		cache_slots = MIN_CACHE_SLOTS;
+
+	ChunkedWorld* world = new ChunkedWorld;
+	world->file = file;
+	world->header = header;
+	world->index = index;
+	world->read_buffer = new byte_t[run_length_bound(2 * CHUNK_TILES)];
+
+	world->slots = new ChunkSlot[cache_slots];
+	world->slot_count = cache_slots;
+	for(int i = 0; i < cache_slots; ++i)
+	{
+		ChunkSlot& slot = world->slots[i];
+		slot.state.store(SLOT_EMPTY);
+		slot.chunk_x = -1;
+		slot.chunk_y = -1;
+		slot.last_used = 0;
+	}
+	world->frame = 0;
+
+	world->stream = begin_tile_stream(fetch_from_chunks, world);
+
+	world->quit = false;
+	world->requests = new int[cache_slots];
+	world->request_first = 0;
+	world->request_count = 0;
+	world->finished = new int[2 * cache_slots];
+	world->finished_count = 0;
+
+	world->loader = std::thread(loader_main, world);
+
+	return world;
+}
+
+void close_chunked_world(ChunkedWorld* world)
+{
+	if(world == nullptr) return;
+
+	{
+		std::lock_guard<std::mutex> lock(world->mutex);
+		world->quit = true;
+	}
+	world->requests_ready.notify_one();
+	world->loader.join();
+
+	close_file_stream(world->file);
+
+	delete[] world->finished;
+	delete[] world->requests;
+	delete[] world->slots;
+	delete[] world->read_buffer;
+	delete[] world->index;
+	delete world;
+}
+
+static ChunkSlot* claim_slot(ChunkedWorld* world)
+{
+	// Prefer an empty slot, and otherwise the least recently used chunk that
+	// isn't wanted this frame. Slots that are loading belong to the loader.
+	ChunkSlot* best = nullptr;
+	for(int i = 0; i < world->slot_count; ++i)
+	{
+		ChunkSlot& slot = world->slots[i];
+		int state = slot.state.load();
+		if(state == SLOT_EMPTY)
+			return &slot;
+
+		if(state == SLOT_READY && slot.last_used != world->frame)
+		{
+			if(best == nullptr || slot.last_used < best->last_used)
+				best = &slot;
+		}
+	}
+	return best;
+}
+
+struct ChunkRange
+{
+	int first_x, first_y;
+	int last_x, last_y; // inclusive
+};
+
+static ChunkRange find_chunk_range(const ChunkedWorld* world, int left, int top, int right, int bottom)
+{
+	ChunkRange range;
+	range.first_x = floor_divide(left, WORLD_CHUNK_DIMENSION);
+	range.first_y = floor_divide(top, WORLD_CHUNK_DIMENSION);
+	range.last_x = floor_divide(right - 1, WORLD_CHUNK_DIMENSION);
+	range.last_y = floor_divide(bottom - 1, WORLD_CHUNK_DIMENSION);
+
+	if(range.first_x < 0) range.first_x = 0;
+	if(range.first_y < 0) range.first_y = 0;
+	if(range.last_x >= world->header.chunk_columns) range.last_x = world->header.chunk_columns - 1;
+	if(range.last_y >= world->header.chunk_rows) range.last_y = world->header.chunk_rows - 1;
+	return range;
+}
+
+static ChunkSlot* find_slot(ChunkedWorld* world, int chunk_x, int chunk_y)
+{
+	for(int i = 0; i < world->slot_count; ++i)
+	{
+		ChunkSlot& slot = world->slots[i];
+		if(slot.chunk_x == chunk_x && slot.chunk_y == chunk_y && slot.state.load() != SLOT_EMPTY)
+			return &slot;
+	}
+	return nullptr;
+}
+
+// Marks every chunk in the area that's resident or on its way as used this
+// frame, so that none of them get evicted to make room for another.
+static void keep_chunks(ChunkedWorld* world, int left, int top, int right, int bottom)
+{
+	ChunkRange range = find_chunk_range(world, left, top, right, bottom);
+	for(int chunk_y = range.first_y; chunk_y <= range.last_y; ++chunk_y)
+	{
+		for(int chunk_x = range.first_x; chunk_x <= range.last_x; ++chunk_x)
+		{
+			ChunkSlot* slot = find_slot(world, chunk_x, chunk_y);
+			if(slot != nullptr)
+				slot->last_used = world->frame;
+		}
+	}
+}
+
+static void request_chunks(ChunkedWorld* world, int left, int top, int right, int bottom)
+{
+	ChunkRange range = find_chunk_range(world, left, top, right, bottom);
+	for(int chunk_y = range.first_y; chunk_y <= range.last_y; ++chunk_y)
+	{
+		for(int chunk_x = range.first_x; chunk_x <= range.last_x; ++chunk_x)
+		{
+			// chunks already resident or on their way were kept already
+			if(find_slot(world, chunk_x, chunk_y) != nullptr) continue;
+
+			ChunkSlot* slot = claim_slot(world);
+			if(slot == nullptr) return;
+
+			slot->state.store(SLOT_LOADING);
+			slot->chunk_x = chunk_x;
+			slot->chunk_y = chunk_y;
+			slot->last_used = world->frame;
+
+			{
+				std::lock_guard<std::mutex> lock(world->mutex);
+				int last = (world->request_first + world->request_count) % world->slot_count;
+				world->requests[last] = static_cast<int>(slot - world->slots);
+				world->request_count += 1;
+			}
+			world->requests_ready.notify_one();
+		}
+	}
+}
+
+void stream_chunked_world(ChunkedWorld* world, Tilemap& ring, int camera_x, int camera_y, int view_width, int view_height)
+{
+	world->frame += 1;
+
+	// Copy in chunks that finished loading since last frame. The loader runs
+	// alongside all of this, so a slot it finished may since have been given
+	// to another chunk, which is then still loading and gets reported again
+	// once it's done.
+	int finished[256];
+	int finished_count;
+	{
+		std::lock_guard<std::mutex> lock(world->mutex);
+		finished_count = world->finished_count;
+		if(finished_count > static_cast<int>(ARRAY_COUNT(finished)))
+			finished_count = ARRAY_COUNT(finished);
+		COPY(world->finished, finished, finished_count);
+		world->finished_count -= finished_count;
+		memmove(world->finished, world->finished + finished_count, sizeof(int) * world->finished_count);
+	}
+
+	for(int i = 0; i < finished_count; ++i)
+	{
+		const ChunkSlot& slot = world->slots[finished[i]];
+		if(slot.state.load() != SLOT_READY) continue;
+
+		TileRect region;
+		region.left = slot.chunk_x * WORLD_CHUNK_DIMENSION;
+		region.top = slot.chunk_y * WORLD_CHUNK_DIMENSION;
+		region.right = region.left + WORLD_CHUNK_DIMENSION;
+		region.bottom = region.top + WORLD_CHUNK_DIMENSION;
+		restream_tiles(world->stream, ring, region);
+	}
+
+	stream_tiles(world->stream, ring, camera_x, camera_y, view_width, view_height);
+
+	// Everything wanted this frame is kept before anything is requested, so a
+	// request can't evict a chunk that's about to be asked for. Then ask for
+	// what's in the window first, and then for what's around it.
+	int left = world->stream.origin_x;
+	int top = world->stream.origin_y;
+	int right = left + ring.columns;
+	int bottom = top + ring.rows;
+	keep_chunks(world, left - PREFETCH_MARGIN, top - PREFETCH_MARGIN, right + PREFETCH_MARGIN, bottom + PREFETCH_MARGIN);
+	request_chunks(world, left, top, right, bottom);
+	request_chunks(world, left - PREFETCH_MARGIN, top - PREFETCH_MARGIN, right + PREFETCH_MARGIN, bottom + PREFETCH_MARGIN);
+}
+
+void save_chunked_world(const Tilemap& map, const char* filename)
+{
+	char path[128];
+	concatenate("resources/tilemaps/", filename, path);
+
+	WorldFileHeader header = {};
+	header.magic = WORLD_FILE_MAGIC;
+	header.version = WORLD_FILE_VERSION;
+	header.chunk_dimension = WORLD_CHUNK_DIMENSION;
+	header.columns = static_cast<uint16_t>(map.columns);
+	header.rows = static_cast<uint16_t>(map.rows);
+	header.chunk_columns = static_cast<uint16_t>((map.columns + WORLD_CHUNK_DIMENSION - 1) / WORLD_CHUNK_DIMENSION);
+	header.chunk_rows = static_cast<uint16_t>((map.rows + WORLD_CHUNK_DIMENSION - 1) / WORLD_CHUNK_DIMENSION);
+
+	int chunk_count = header.chunk_columns * header.chunk_rows;
+	size_t data_offset = sizeof header + sizeof(WorldFileChunk) * chunk_count;
+
+	WorldFileChunk* index = new WorldFileChunk[chunk_count];
+	byte_t* data = new byte_t[run_length_bound(2 * CHUNK_TILES) * chunk_count];
+	size_t data_size = 0;
+
+	byte_t planes[2 * CHUNK_TILES];
+	for(int chunk_y = 0; chunk_y < header.chunk_rows; ++chunk_y)
+	{
+		for(int chunk_x = 0; chunk_x < header.chunk_columns; ++chunk_x)
+		{
+			CLEAR_ARRAY(planes);
+			for(int y = 0; y < WORLD_CHUNK_DIMENSION; ++y)
+			{
+				int map_y = chunk_y * WORLD_CHUNK_DIMENSION + y;
+				if(map_y >= map.rows) break;
+
+				for(int x = 0; x < WORLD_CHUNK_DIMENSION; ++x)
+				{
+					int map_x = chunk_x * WORLD_CHUNK_DIMENSION + x;
+					if(map_x >= map.columns) break;
+
+					planes[y * WORLD_CHUNK_DIMENSION + x] = map.tiles[map_y * map.columns + map_x];
+					planes[CHUNK_TILES + y * WORLD_CHUNK_DIMENSION + x] = map.attributes[map_y * map.columns + map_x];
+				}
+			}
+
+			// keep a chunk raw whenever encoding it wouldn't make it any smaller
+			WorldFileChunk& chunk = index[chunk_y * header.chunk_columns + chunk_x];
+			chunk.offset = static_cast<uint32_t>(data_offset + data_size);
+
+			size_t encoded = run_length_encode(planes, sizeof planes, data + data_size);
+			if(encoded < sizeof planes)
+			{
+				chunk.stored_size = static_cast<uint32_t>(encoded);
+				chunk.method = WORLD_CHUNK_RUN_LENGTH;
+			}
+			else
+			{
+				COPY(planes, data + data_size, sizeof planes);
+				chunk.stored_size = sizeof planes;
+				chunk.method = WORLD_CHUNK_RAW;
+			}
+			data_size += chunk.stored_size;
+		}
+	}
+
+	size_t size = data_offset + data_size;
+	byte_t* file = new byte_t[size];
+	COPY(reinterpret_cast<const byte_t*>(&header), file, sizeof header);
+	COPY(reinterpret_cast<const byte_t*>(index), file + sizeof header, sizeof(WorldFileChunk) * chunk_count);
+	COPY(data, file + data_offset, data_size);
+
+	save_binary_file(file, size, path);
+
+	delete[] file;
+	delete[] data;
+	delete[] index;
+}
@@ -0,0 +1,26 @@
+#ifndef CHUNKED_WORLD_H
+#define CHUNKED_WORLD_H
+
+#include "Tilemap.h"
+
+// A world map stored on disk as square chunks of tiles, of which only those
+// around the camera are kept in memory. Chunks are read and decompressed on a
+// background thread into a fixed number of cache slots that get recycled
+// least-recently-used first, so memory use doesn't depend on the world's size.
+
+#define WORLD_CHUNK_DIMENSION 32
+
+struct ChunkedWorld;
+
+ChunkedWorld* open_chunked_world(const char* filename, int cache_slots);
+void close_chunked_world(ChunkedWorld* world);
+
+// Call once a frame to keep a ring buffer tilemap filled around the camera,
+// as stream_tiles does for a whole map. This never waits on the loading
+// thread: tiles of chunks that haven't arrived yet are left blank and then
+// filled in on the frame their chunk does.
+void stream_chunked_world(ChunkedWorld* world, Tilemap& ring, int camera_x, int camera_y, int view_width, int view_height);
+
+void save_chunked_world(const Tilemap& map, const char* filename);
+
+#endif
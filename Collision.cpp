@@ -0,0 +1,327 @@
+#include "Collision.h"
+
+#include "utilities/ArrayMacros.h"
+
+#define TILE_DIMENSION 8
+
+// a few entities' worth at first, doubling as needed
+#define INITIAL_CELL_CAPACITY 16
+
+CollisionGrid create_collision_grid(int capacity)
+{
+	CollisionGrid grid = {};
+	grid.cell_of = new int16_t[capacity];
+	grid.slot_of = new int[capacity];
+	grid.count = 0;
+	grid.capacity = capacity;
+	return grid;
+}
+
+void destroy_collision_grid(CollisionGrid& grid)
+{
+	for(int i = 0; i < COLLISION_CELLS; ++i)
+	{
+		delete[] grid.cells[i].entities;
+		delete[] grid.cells[i].positions;
+	}
+	delete[] grid.cell_of;
+	delete[] grid.slot_of;
+	grid = {};
+}
+
+static inline int find_cell(word_t x, word_t y)
+{
+	int column = (x >> 8) / COLLISION_CELL_SIZE;
+	int row = (y >> 8) / COLLISION_CELL_SIZE;
+	return row * COLLISION_GRID_SIZE + column;
+}
+
+static void reserve_slots(CollisionCell& cell, int capacity)
+{
+	if(capacity <= cell.capacity) return;
+
+	int* entities = new int[capacity];
+	word_t* positions = new word_t[capacity];
+	COPY(cell.entities, entities, cell.count);
+	COPY(cell.positions, positions, cell.count);
+	delete[] cell.entities;
+	delete[] cell.positions;
+
+	cell.entities = entities;
+	cell.positions = positions;
+	cell.capacity = capacity;
+}
+
+static inline void add_to_cell(CollisionGrid& grid, int entity, int index)
+{
+	CollisionCell& cell = grid.cells[index];
+	if(cell.count == cell.capacity)
+	{
+		int capacity = (cell.capacity > 0) ? 2 * cell.capacity : INITIAL_CELL_CAPACITY;
+		reserve_slots(cell, capacity);
+	}
+
+	cell.entities[cell.count] = entity;
+	grid.cell_of[entity] = index;
+	grid.slot_of[entity] = cell.count;
+	cell.count += 1;
+}
+
+static inline void remove_from_cell(CollisionGrid& grid, int entity)
+{
+	// the cell's last entity is moved into the removed one's slot
+	CollisionCell& cell = grid.cells[grid.cell_of[entity]];
+	int slot = grid.slot_of[entity];
+	int last = cell.count - 1;
+	int moved = cell.entities[last];
+	cell.entities[slot] = moved;
+	cell.positions[slot] = cell.positions[last];
+	grid.slot_of[moved] = slot;
+	cell.count = last;
+}
+
+void update_collision_grid(CollisionGrid& grid, const EntityPool& pool)
+{
+	int count = (pool.count < grid.capacity) ? pool.count : grid.capacity;
+
+	// despawning moves the last entity down, so whatever's past the end now
+	// is gone, and the one that moved gets seen as changing cell below
+	for(int i = count; i < grid.count; ++i)
+	{
+		remove_from_cell(grid, i);
+	}
+
+	for(int i = 0; i < count; ++i)
+	{
+		word_t x = pool.position_x[i];
+		word_t y = pool.position_y[i];
+		int cell = find_cell(x, y);
+		if(i >= grid.count)
+		{
+			add_to_cell(grid, i, cell);
+		}
+		else if(cell != grid.cell_of[i])
+		{
+			remove_from_cell(grid, i);
+			add_to_cell(grid, i, cell);
+		}
+		grid.cells[cell].positions[grid.slot_of[i]] = (x >> 8) | (y & 0xFF00);
+	}
+
+	grid.count = count;
+}
+
+// returns false if it ran out of room for hits
+static bool find_query_overlaps(const CollisionGrid& grid, const OverlapQuery& query, int query_index, CollisionHit hits[], int max_hits, int& hit_count)
+{
+	// An entity overlaps the box when its corner is anywhere from a sprite's
+	// width less one before the box's corner, to the box's far edge.
+	int left = (query.x - (ENTITY_SIZE - 1)) & 0xFF;
+	int top = (query.y - (ENTITY_SIZE - 1)) & 0xFF;
+	int span_x = query.width + ENTITY_SIZE - 1;
+	int span_y = query.height + ENTITY_SIZE - 1;
+
+	int first_column = left / COLLISION_CELL_SIZE;
+	int first_row = top / COLLISION_CELL_SIZE;
+	int columns = (left % COLLISION_CELL_SIZE + span_x - 1) / COLLISION_CELL_SIZE + 1;
+	int rows = (top % COLLISION_CELL_SIZE + span_y - 1) / COLLISION_CELL_SIZE + 1;
+	if(columns > COLLISION_GRID_SIZE) columns = COLLISION_GRID_SIZE;
+	if(rows > COLLISION_GRID_SIZE) rows = COLLISION_GRID_SIZE;
+
+	for(int i = 0; i < rows; ++i)
+	{
+		int row = (first_row + i) % COLLISION_GRID_SIZE;
+		for(int j = 0; j < columns; ++j)
+		{
+			int column = (first_column + j) % COLLISION_GRID_SIZE;
+			const CollisionCell& cell = grid.cells[row * COLLISION_GRID_SIZE + column];
+			for(int k = 0; k < cell.count; ++k)
+			{
+				// distances wrap around the same way the positions do
+				word_t position = cell.positions[k];
+				int dx = ((position & 0xFF) - left) & 0xFF;
+				int dy = ((position >> 8) - top) & 0xFF;
+				if(dx >= span_x || dy >= span_y)
+					continue;
+
+				int entity = cell.entities[k];
+				if(entity == query.ignore)
+					continue;
+
+				if(hit_count == max_hits)
+					return false;
+				hits[hit_count].query = query_index;
+				hits[hit_count].entity = entity;
+				hit_count += 1;
+			}
+		}
+	}
+	return true;
+}
+
+int find_overlaps(const CollisionGrid& grid, const OverlapQuery queries[], int query_count, CollisionHit hits[], int max_hits, int* hit_count)
+{
+	int count = 0;
+	for(int i = 0; i < query_count; ++i)
+	{
+		int first_hit = count;
+		if(!find_query_overlaps(grid, queries[i], i, hits, max_hits, count))
+		{
+			// Leave this query for next time, unless it's the first, in
+			// which case it won't ever fit and has to be cut short.
+			if(i > 0)
+			{
+				*hit_count = first_hit;
+				return i;
+			}
+			*hit_count = count;
+			return 1;
+		}
+	}
+	*hit_count = count;
+	return query_count;
+}
+
+static void fill_tile_solidity(TileSolidity& solidity, const Tilemap& map, int left, int top, int right, int bottom)
+{
+	for(int y = top; y < bottom; ++y)
+	{
+		uint64_t* row = solidity.bits + y * solidity.words_per_row;
+		const byte_t* attributes = map.attributes + y * map.columns;
+		for(int x = left; x < right; ++x)
+		{
+			uint64_t bit = 1ull << (x % 64);
+			if(attributes[x] & solidity.solid_attributes)
+				row[x / 64] |= bit;
+			else
+				row[x / 64] &= ~bit;
+		}
+	}
+}
+
+TileSolidity create_tile_solidity(const Tilemap& map, byte_t solid_attributes)
+{
+	TileSolidity solidity;
+	solidity.columns = map.columns;
+	solidity.rows = map.rows;
+	solidity.words_per_row = (map.columns + 63) / 64;
+	solidity.solid_attributes = solid_attributes;
+
+	int word_count = solidity.words_per_row * solidity.rows;
+	solidity.bits = new uint64_t[word_count];
+	CLEAR(solidity.bits, word_count);
+	fill_tile_solidity(solidity, map, 0, 0, map.columns, map.rows);
+
+	return solidity;
+}
+
+void destroy_tile_solidity(TileSolidity& solidity)
+{
+	delete[] solidity.bits;
+	solidity = {};
+}
+
+void update_tile_solidity(TileSolidity& solidity, const Tilemap& map, const TileRect& rect)
+{
+	fill_tile_solidity(solidity, map, rect.left, rect.top, rect.right, rect.bottom);
+}
+
+static inline int tile_at(int pixel)
+{
+	// rounds down, for pixels above or left of the map too
+	return (pixel >= 0) ? pixel / TILE_DIMENSION : -((TILE_DIMENSION - 1 - pixel) / TILE_DIMENSION);
+}
+
+static bool column_blocked(const TileSolidity& solidity, int column, int top_row, int bottom_row)
+{
+	for(int row = top_row; row <= bottom_row; ++row)
+	{
+		if(is_tile_solid(solidity, column, row)) return true;
+	}
+	return false;
+}
+
+static bool row_blocked(const TileSolidity& solidity, int row, int left_column, int right_column)
+{
+	for(int column = left_column; column <= right_column; ++column)
+	{
+		if(is_tile_solid(solidity, column, row)) return true;
+	}
+	return false;
+}
+
+// Only the tiles the leading edge moves into are checked, a column or row at
+// a time, and the box stops flush against the first solid one.
+
+static int sweep_across(const TileSolidity& solidity, int x, int y, int move, bool* hit)
+{
+	int top_row = tile_at(y);
+	int bottom_row = tile_at(y + ENTITY_SIZE - 1);
+	if(move > 0)
+	{
+		int edge = x + ENTITY_SIZE - 1;
+		for(int column = tile_at(edge) + 1; column <= tile_at(edge + move); ++column)
+		{
+			if(column_blocked(solidity, column, top_row, bottom_row))
+			{
+				*hit = true;
+				return column * TILE_DIMENSION - ENTITY_SIZE - x;
+			}
+		}
+	}
+	else if(move < 0)
+	{
+		for(int column = tile_at(x) - 1; column >= tile_at(x + move); --column)
+		{
+			if(column_blocked(solidity, column, top_row, bottom_row))
+			{
+				*hit = true;
+				return (column + 1) * TILE_DIMENSION - x;
+			}
+		}
+	}
+	return move;
+}
+
+static int sweep_down(const TileSolidity& solidity, int x, int y, int move, bool* hit)
+{
+	int left_column = tile_at(x);
+	int right_column = tile_at(x + ENTITY_SIZE - 1);
+	if(move > 0)
+	{
+		int edge = y + ENTITY_SIZE - 1;
+		for(int row = tile_at(edge) + 1; row <= tile_at(edge + move); ++row)
+		{
+			if(row_blocked(solidity, row, left_column, right_column))
+			{
+				*hit = true;
+				return row * TILE_DIMENSION - ENTITY_SIZE - y;
+			}
+		}
+	}
+	else if(move < 0)
+	{
+		for(int row = tile_at(y) - 1; row >= tile_at(y + move); --row)
+		{
+			if(row_blocked(solidity, row, left_column, right_column))
+			{
+				*hit = true;
+				return (row + 1) * TILE_DIMENSION - y;
+			}
+		}
+	}
+	return move;
+}
+
+void sweep_against_tiles(const TileSolidity& solidity, const SweepQuery queries[], SweepResult results[], int count)
+{
+	for(int i = 0; i < count; ++i)
+	{
+		const SweepQuery& query = queries[i];
+		SweepResult& result = results[i];
+		result.hit_x = false;
+		result.hit_y = false;
+		result.x = query.x + sweep_across(solidity, query.x, query.y, query.move_x, &result.hit_x);
+		result.y = query.y + sweep_down(solidity, result.x, query.y, query.move_y, &result.hit_y);
+	}
+}
@@ -0,0 +1,110 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include "EntityPool.h"
+#include "Tilemap.h"
+
+#include <cstdint>
+
+// Every entity collides as a box the size of a sprite, with its corner at its
+// pixel position. Positions wrap around at 256 pixels, and so does the grid:
+// the world is split into cells a sprite across and an entity's cell is its
+// position's high bits, which makes the grid a spatial hash that never has
+// two places sharing a cell. Each cell keeps its entities' positions packed
+// next to them, so a query only reads the cells it covers. Updating the grid
+// only moves the entities that changed cell; the rest just get their
+// positions written in place.
+
+#define ENTITY_SIZE         8
+#define COLLISION_CELL_SIZE 8
+#define COLLISION_GRID_SIZE (256 / COLLISION_CELL_SIZE)
+#define COLLISION_CELLS     (COLLISION_GRID_SIZE * COLLISION_GRID_SIZE)
+
+struct CollisionCell
+{
+	int* entities;
+	word_t* positions; // x in the low byte and y in the high byte, in pixels
+	int count;
+	int capacity;
+};
+
+struct CollisionGrid
+{
+	CollisionCell cells[COLLISION_CELLS];
+	int16_t* cell_of; // for each entity, which cell it's in
+	int* slot_of; // and where in that cell
+	int count; // how many of the pool's entities are in the grid
+	int capacity;
+};
+
+CollisionGrid create_collision_grid(int capacity);
+void destroy_collision_grid(CollisionGrid& grid);
+
+// Brings the grid up to date with where the pool's entities are now,
+// including any spawned or despawned since the last update.
+void update_collision_grid(CollisionGrid& grid, const EntityPool& pool);
+
+struct OverlapQuery
+{
+	int x, y; // pixels, wrapping around like entity positions
+	int width, height; // at most 248
+	int ignore; // an entity not to report, like the box's own, or else -1
+};
+
+struct CollisionHit
+{
+	int query;
+	int entity;
+};
+
+// Finds the entities overlapping each box, writing a hit for each one. Stops
+// early rather than answer a query partway when its hits don't fit, and
+// returns how many of the queries were answered, so the rest can be asked
+// again after the hits so far are dealt with. The one exception is a single
+// query with more hits than fit, which is cut short.
+int find_overlaps(const CollisionGrid& grid, const OverlapQuery queries[], int query_count, CollisionHit hits[], int max_hits, int* hit_count);
+
+// One bit per tile of a map, set for tiles with any of the given attribute
+// bits, so checking a tile is a single lookup.
+struct TileSolidity
+{
+	uint64_t* bits;
+	int columns, rows;
+	int words_per_row;
+	byte_t solid_attributes;
+};
+
+TileSolidity create_tile_solidity(const Tilemap& map, byte_t solid_attributes);
+void destroy_tile_solidity(TileSolidity& solidity);
+
+// for keeping up with tiles changed since it was made
+void update_tile_solidity(TileSolidity& solidity, const Tilemap& map, const TileRect& rect);
+
+static inline bool is_tile_solid(const TileSolidity& solidity, int column, int row)
+{
+	// past the edges the map repeats, as it does when drawn
+	column %= solidity.columns;
+	row %= solidity.rows;
+	if(column < 0) column += solidity.columns;
+	if(row < 0) row += solidity.rows;
+	uint64_t word = solidity.bits[row * solidity.words_per_row + column / 64];
+	return (word >> (column % 64)) & 1;
+}
+
+// An entity-sized box moved by some number of pixels, first across and then
+// down, stopping short of any solid tile in its way.
+struct SweepQuery
+{
+	int x, y; // pixels in the map
+	int move_x, move_y;
+};
+
+struct SweepResult
+{
+	int x, y; // where the box ends up
+	bool hit_x, hit_y; // whether it was stopped going across or down
+};
+
+void sweep_against_tiles(const TileSolidity& solidity, const SweepQuery queries[], SweepResult results[], int count);
+
+#endif
@@ -0,0 +1,241 @@
+#include "EntityPool.h"
+
+#include "utilities/ArrayMacros.h"
+#include "utilities/Logging.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
+// the size of the Game Boy's screen, in pixels
+#define SCREEN_WIDTH  160
+#define SCREEN_HEIGHT 144
+
+#define ENTITIES_PER_BLOCK 8
+
+static inline int round_up_to_block(int count)
+{
+	return (count + ENTITIES_PER_BLOCK - 1) & ~(ENTITIES_PER_BLOCK - 1);
+}
+
+EntityPool create_entity_pool(int capacity)
+{
+	int stride = round_up_to_block(capacity);
+
+	EntityPool pool;
+	pool.position_x = new word_t[stride];
+	pool.position_y = new word_t[stride];
+	pool.previous_x = new word_t[stride];
+	pool.previous_y = new word_t[stride];
+	pool.velocity_x = new int16_t[stride];
+	pool.velocity_y = new int16_t[stride];
+	pool.tile_number = new byte_t[stride];
+	pool.attribute = new byte_t[stride];
+	pool.count = 0;
+	pool.capacity = capacity;
+
+	// the scratch space past count gets moved along with everything else, so
+	// it should at least start out as something
+	CLEAR(pool.position_x, stride);
+	CLEAR(pool.position_y, stride);
+	CLEAR(pool.previous_x, stride);
+	CLEAR(pool.previous_y, stride);
+	CLEAR(pool.velocity_x, stride);
+	CLEAR(pool.velocity_y, stride);
+	CLEAR(pool.tile_number, stride);
+	CLEAR(pool.attribute, stride);
+
+	return pool;
+}
+
+void destroy_entity_pool(EntityPool& pool)
+{
+	delete[] pool.position_x;
+	delete[] pool.position_y;
+	delete[] pool.previous_x;
+	delete[] pool.previous_y;
+	delete[] pool.velocity_x;
+	delete[] pool.velocity_y;
+	delete[] pool.tile_number;
+	delete[] pool.attribute;
+	pool = {};
+}
+
+int spawn_entity(EntityPool& pool, byte_t x, byte_t y, byte_t tile_number, byte_t attribute)
+{
+	if(pool.count >= pool.capacity) return -1;
+
+	int i = pool.count;
+	pool.position_x[i] = x << 8;
+	pool.position_y[i] = y << 8;
+	pool.previous_x[i] = pool.position_x[i];
+	pool.previous_y[i] = pool.position_y[i];
+	pool.velocity_x[i] = 0;
+	pool.velocity_y[i] = 0;
+	pool.tile_number[i] = tile_number;
+	pool.attribute[i] = attribute;
+	pool.count += 1;
+
+	return i;
+}
+
+void despawn_entity(EntityPool& pool, int index)
+{
+	int last = pool.count - 1;
+	pool.position_x[index] = pool.position_x[last];
+	pool.position_y[index] = pool.position_y[last];
+	pool.previous_x[index] = pool.previous_x[last];
+	pool.previous_y[index] = pool.previous_y[last];
+	pool.velocity_x[index] = pool.velocity_x[last];
+	pool.velocity_y[index] = pool.velocity_y[last];
+	pool.tile_number[index] = pool.tile_number[last];
+	pool.attribute[index] = pool.attribute[last];
+	pool.count = last;
+}
+
+#if defined(USE_SSE2)
+
+static inline void move_block(word_t* position, word_t* previous, const int16_t* velocity, __m128i push)
+{
+	__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(position));
+	__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(velocity));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(previous), p);
+	p = _mm_add_epi16(p, _mm_add_epi16(v, push));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(position), p);
+}
+
+void move_entities(EntityPool& pool, int16_t push_x, int16_t push_y)
+{
+	// Whole blocks are moved even past the end, into the scratch space, which
+	// saves having to finish off the last few one at a time.
+	__m128i push_x8 = _mm_set1_epi16(push_x);
+	__m128i push_y8 = _mm_set1_epi16(push_y);
+	for(int i = 0; i < pool.count; i += ENTITIES_PER_BLOCK)
+	{
+		move_block(pool.position_x + i, pool.previous_x + i, pool.velocity_x + i, push_x8);
+		move_block(pool.position_y + i, pool.previous_y + i, pool.velocity_y + i, push_y8);
+	}
+}
+
+int select_visible_entities(const EntityPool& pool, int* indices, int max_count)
+{
+	const __m128i width = _mm_set1_epi16(SCREEN_WIDTH);
+	const __m128i height = _mm_set1_epi16(SCREEN_HEIGHT);
+
+	int selected = 0;
+	for(int i = 0; i < pool.count && selected < max_count; i += ENTITIES_PER_BLOCK)
+	{
+		// pixel positions only go up to 255, so comparing them as signed is fine
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pool.position_x + i));
+		__m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pool.position_y + i));
+		__m128i in_x = _mm_cmplt_epi16(_mm_srli_epi16(x, 8), width);
+		__m128i in_y = _mm_cmplt_epi16(_mm_srli_epi16(y, 8), height);
+		int visible = _mm_movemask_epi8(_mm_and_si128(in_x, in_y));
+		if(visible == 0) continue;
+
+		// each entity gets two bits of the mask, one for each of its bytes
+		int end = pool.count - i;
+		if(end > ENTITIES_PER_BLOCK) end = ENTITIES_PER_BLOCK;
+		for(int j = 0; j < end && selected < max_count; ++j)
+		{
+			if(visible & (1 << (2 * j)))
+			{
+				indices[selected] = i + j;
+				selected += 1;
+			}
+		}
+	}
+	return selected;
+}
+
+#else
+
+void move_entities(EntityPool& pool, int16_t push_x, int16_t push_y)
+{
+	for(int i = 0; i < pool.count; ++i)
+	{
+		pool.previous_x[i] = pool.position_x[i];
+		pool.previous_y[i] = pool.position_y[i];
+		pool.position_x[i] += pool.velocity_x[i] + push_x;
+		pool.position_y[i] += pool.velocity_y[i] + push_y;
+	}
+}
+
+int select_visible_entities(const EntityPool& pool, int* indices, int max_count)
+{
+	int selected = 0;
+	for(int i = 0; i < pool.count && selected < max_count; ++i)
+	{
+		if((pool.position_x[i] >> 8) < SCREEN_WIDTH && (pool.position_y[i] >> 8) < SCREEN_HEIGHT)
+		{
+			indices[selected] = i;
+			selected += 1;
+		}
+	}
+	return selected;
+}
+
+#endif // defined(USE_SSE2)
+
+// Saved pools are the count followed by each array in full, so that the size
+// stays the same however many entities there are.
+
+size_t saved_entities_size(const EntityPool& pool)
+{
+	size_t per_entity = 6 * sizeof(word_t) + 2 * sizeof(byte_t);
+	return sizeof(int32_t) + per_entity * pool.capacity;
+}
+
+void save_entities(const EntityPool& pool, void* data)
+{
+	int32_t count = pool.count;
+	byte_t* bytes = static_cast<byte_t*>(data);
+	COPY(reinterpret_cast<const byte_t*>(&count), bytes, sizeof count);
+	bytes += sizeof count;
+
+	int n = pool.capacity;
+	COPY(pool.position_x, reinterpret_cast<word_t*>(bytes), n); bytes += sizeof(word_t) * n;
+	COPY(pool.position_y, reinterpret_cast<word_t*>(bytes), n); bytes += sizeof(word_t) * n;
+	COPY(pool.previous_x, reinterpret_cast<word_t*>(bytes), n); bytes += sizeof(word_t) * n;
+	COPY(pool.previous_y, reinterpret_cast<word_t*>(bytes), n); bytes += sizeof(word_t) * n;
+	COPY(pool.velocity_x, reinterpret_cast<int16_t*>(bytes), n); bytes += sizeof(int16_t) * n;
+	COPY(pool.velocity_y, reinterpret_cast<int16_t*>(bytes), n); bytes += sizeof(int16_t) * n;
+	COPY(pool.tile_number, bytes, n); bytes += n;
+	COPY(pool.attribute, bytes, n);
+}
+
+bool can_load_entities(const EntityPool& pool, const void* data)
+{
+	int32_t count;
+	COPY(static_cast<const byte_t*>(data), reinterpret_cast<byte_t*>(&count), sizeof count);
+	if(count < 0 || count > pool.capacity)
+	{
+		LOG_ISSUE("saved entity count %i doesn't fit a pool of %i", count, pool.capacity);
+		return false;
+	}
+	return true;
+}
+
+bool load_entities(EntityPool& pool, const void* data)
+{
+	if(!can_load_entities(pool, data))
+		return false;
+
+	int32_t count;
+	const byte_t* bytes = static_cast<const byte_t*>(data);
+	COPY(bytes, reinterpret_cast<byte_t*>(&count), sizeof count);
+	bytes += sizeof count;
+	pool.count = count;
+
+	int n = pool.capacity;
+	COPY(reinterpret_cast<const word_t*>(bytes), pool.position_x, n); bytes += sizeof(word_t) * n;
+	COPY(reinterpret_cast<const word_t*>(bytes), pool.position_y, n); bytes += sizeof(word_t) * n;
+	COPY(reinterpret_cast<const word_t*>(bytes), pool.previous_x, n); bytes += sizeof(word_t) * n;
+	COPY(reinterpret_cast<const word_t*>(bytes), pool.previous_y, n); bytes += sizeof(word_t) * n;
+	COPY(reinterpret_cast<const int16_t*>(bytes), pool.velocity_x, n); bytes += sizeof(int16_t) * n;
+	COPY(reinterpret_cast<const int16_t*>(bytes), pool.velocity_y, n); bytes += sizeof(int16_t) * n;
+	COPY(bytes, pool.tile_number, n); bytes += n;
+	COPY(bytes, pool.attribute, n);
+	return true;
+}
@@ -0,0 +1,57 @@
+#ifndef ENTITY_POOL_H
+#define ENTITY_POOL_H
+
+#include "GameBoyTypes.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Holds every moving thing in the game, however many there are, of which at
+// most MAX_SPRITES at a time end up in OAM to be drawn. Each field is its own
+// array, so that moving them all is a straight run through a few arrays that
+// goes eight entities at a time with SSE2.
+//
+// Positions are 8.8 fixed point, the high byte being the pixel, so that like
+// OAM positions they wrap around at 256. Velocities are in the same units per
+// step. The arrays have room for capacity rounded up to a multiple of eight,
+// and whatever's past count is scratch space.
+
+struct EntityPool
+{
+	word_t* position_x;
+	word_t* position_y;
+	word_t* previous_x; // where each was as of the step before
+	word_t* previous_y;
+	int16_t* velocity_x;
+	int16_t* velocity_y;
+	byte_t* tile_number;
+	byte_t* attribute;
+	int count;
+	int capacity;
+};
+
+EntityPool create_entity_pool(int capacity);
+void destroy_entity_pool(EntityPool& pool);
+
+// returns the new entity's index, or -1 if the pool is full
+int spawn_entity(EntityPool& pool, byte_t x, byte_t y, byte_t tile_number, byte_t attribute);
+
+// The last entity is moved into the removed one's place, so its index changes.
+void despawn_entity(EntityPool& pool, int index);
+
+// Moves every entity along by its velocity plus a push that's the same for
+// all of them, keeping where they were in previous_x and previous_y.
+void move_entities(EntityPool& pool, int16_t push_x, int16_t push_y);
+
+// Writes the indices of the first max_count entities, in pool order, that are
+// on screen. Returns how many there were.
+int select_visible_entities(const EntityPool& pool, int* indices, int max_count);
+
+// for saving the pool along with the rest of the game's state, where loading
+// leaves the pool as it was if the saved count doesn't fit
+size_t saved_entities_size(const EntityPool& pool);
+void save_entities(const EntityPool& pool, void* data);
+bool can_load_entities(const EntityPool& pool, const void* data);
+bool load_entities(EntityPool& pool, const void* data);
+
+#endif
@@ -0,0 +1,38 @@
+#include "FixedTimestep.h"
+
+#include <cmath>
+
+FixedTimestep create_fixed_timestep(double steps_per_second)
+{
+	FixedTimestep timestep;
+	timestep.step = 1.0 / steps_per_second;
+	timestep.accumulator = 0.0;
+	return timestep;
+}
+
+int advance_timestep(FixedTimestep& timestep, double elapsed_seconds)
+{
+	if(elapsed_seconds > 0.0)
+		timestep.accumulator += elapsed_seconds;
+
+	int steps = 0;
+	while(timestep.accumulator >= timestep.step)
+	{
+		if(steps == MAX_STEPS_PER_FRAME)
+		{
+			// drop the time that can't be caught up on, keeping the fraction
+			timestep.accumulator = fmod(timestep.accumulator, timestep.step);
+			break;
+		}
+		timestep.accumulator -= timestep.step;
+		++steps;
+	}
+	return steps;
+}
+
+double timestep_interpolation(const FixedTimestep& timestep)
+{
+	double alpha = timestep.accumulator / timestep.step;
+	if(alpha >= 1.0) alpha = 0.0;
+	return alpha;
+}
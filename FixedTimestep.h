@@ -0,0 +1,30 @@
+#ifndef FIXED_TIMESTEP_H
+#define FIXED_TIMESTEP_H
+
+// Runs the simulation in steps of exactly the same length however long each
+// frame actually takes. Real time is banked in an accumulator and paid out a
+// whole step at a time; whatever's left over is how far the next step has
+// got, for blending between the last two steps when drawing.
+
+// the DMG/CGB frame rate: a 4194304 Hz clock over 70224 cycles per frame
+#define GAME_BOY_FRAME_RATE 59.7275
+
+// Past this many steps in one frame, the simulation gives up on catching up
+// rather than falling further behind by trying, such as after a breakpoint.
+#define MAX_STEPS_PER_FRAME 5
+
+struct FixedTimestep
+{
+	double step; // seconds
+	double accumulator;
+};
+
+FixedTimestep create_fixed_timestep(double steps_per_second);
+
+// returns how many steps to run for the given real time
+int advance_timestep(FixedTimestep& timestep, double elapsed_seconds);
+
+// how far into the next step, from 0 up to (but not including) 1
+double timestep_interpolation(const FixedTimestep& timestep);
+
+#endif
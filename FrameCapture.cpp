@@ -0,0 +1,288 @@
+#include "FrameCapture.h"
+#include "GLState.h"
+
+#include "utilities/Logging.h"
+#include "utilities/RunLength.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+// How many frames can be in flight on the GPU and waiting for the encoder.
+// A frame that arrives when the encoder has fallen that far behind is dropped.
+#define READBACK_BUFFERS 4
+#define QUEUED_FRAMES    16
+
+// long enough that a readback which hasn't finished by then never will
+#define FENCE_TIMEOUT 1000000000ull // nanoseconds
+
+struct FrameCapture
+{
+	int width;
+	int height;
+	size_t frame_size; // as read back, in RGBA
+
+	GLuint pack_buffers[READBACK_BUFFERS];
+	GLsync fences[READBACK_BUFFERS];
+	int next_readback;
+	int pending_readbacks;
+
+	// frames waiting to be encoded, as they were read back: bottom row first
+	unsigned char* queue;
+	int queue_first;
+	int queue_count;
+	bool finished;
+	std::mutex mutex;
+	std::condition_variable frame_queued;
+
+	std::thread encoder;
+	FILE* file;
+	uint32_t frames_written;
+	int frames_dropped;
+	bool write_failed;
+};
+
+static void write_frame(FrameCapture* capture, const void* data, uint32_t size)
+{
+	if(capture->write_failed) return;
+
+	if(fwrite(&size, sizeof size, 1, capture->file) != 1 ||
+		fwrite(data, 1, size, capture->file) != size)
+	{
+		LOG_ISSUE("couldn't write captured frame %u", capture->frames_written);
+		capture->write_failed = true;
+		return;
+	}
+	capture->frames_written += 1;
+}
+
+static void encode_frames(FrameCapture* capture)
+{
+	int width = capture->width;
+	int height = capture->height;
+	size_t rgb_size = 3 * width * height;
+
+	unsigned char* previous = new unsigned char[rgb_size];
+	unsigned char* current = new unsigned char[rgb_size];
+	unsigned char* delta = new unsigned char[rgb_size];
+	unsigned char* packed = new unsigned char[run_length_bound(rgb_size)];
+	memset(previous, 0, rgb_size);
+
+	for(;;)
+	{
+		const unsigned char* frame;
+		{
+			std::unique_lock<std::mutex> lock(capture->mutex);
+			while(capture->queue_count == 0 && !capture->finished)
+				capture->frame_queued.wait(lock);
+
+			if(capture->queue_count == 0) break;
+			frame = capture->queue + capture->queue_first * capture->frame_size;
+		}
+
+		// flip it the right way up and drop alpha, then difference it against
+		// the last frame, so anything that didn't change becomes a run of zeros
+		for(int y = 0; y < height; ++y)
+		{
+			const unsigned char* in = frame + 4 * width * (height - 1 - y);
+			unsigned char* out = current + 3 * width * y;
+			unsigned char* out_delta = delta + 3 * width * y;
+			const unsigned char* last = previous + 3 * width * y;
+			for(int x = 0; x < width; ++x)
+			{
+				for(int c = 0; c < 3; ++c)
+				{
+					out[3 * x + c] = in[4 * x + c];
+					out_delta[3 * x + c] = in[4 * x + c] ^ last[3 * x + c];
+				}
+			}
+		}
+
+		// the frame's been copied out, so its place in the queue can be reused
+		{
+			std::lock_guard<std::mutex> lock(capture->mutex);
+			capture->queue_first = (capture->queue_first + 1) % QUEUED_FRAMES;
+			capture->queue_count -= 1;
+		}
+
+		size_t size = run_length_encode(delta, rgb_size, packed);
+		write_frame(capture, packed, static_cast<uint32_t>(size));
+
+		unsigned char* swap = previous;
+		previous = current;
+		current = swap;
+	}
+
+	delete[] previous;
+	delete[] current;
+	delete[] delta;
+	delete[] packed;
+}
+
+FrameCapture* begin_frame_capture(const char* filename, int width, int height)
+{
+	FILE* file = fopen(filename, "wb");
+	if(file == nullptr)
+	{
+		LOG_ISSUE("couldn't open file to capture frames to: %s", filename);
+		return nullptr;
+	}
+
+	// the frame count is filled in once capture ends
+	uint16_t dimensions[2] = { static_cast<uint16_t>(width), static_cast<uint16_t>(height) };
+	uint32_t frame_count = 0;
+	fwrite("MNGC", 1, 4, file);
+	fwrite(dimensions, sizeof dimensions, 1, file);
+	fwrite(&frame_count, sizeof frame_count, 1, file);
+
+	FrameCapture* capture = new FrameCapture;
+	capture->width = width;
+	capture->height = height;
+	capture->frame_size = 4 * width * height;
+
+	glGenBuffers(READBACK_BUFFERS, capture->pack_buffers);
+	for(int i = 0; i < READBACK_BUFFERS; ++i)
+	{
+		bind_buffer(GL_PIXEL_PACK_BUFFER, capture->pack_buffers[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, capture->frame_size, nullptr, GL_STREAM_READ);
+		capture->fences[i] = 0;
+	}
+	bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+	capture->next_readback = 0;
+	capture->pending_readbacks = 0;
+
+	capture->queue = new unsigned char[QUEUED_FRAMES * capture->frame_size];
+	capture->queue_first = 0;
+	capture->queue_count = 0;
+	capture->finished = false;
+
+	capture->file = file;
+	capture->frames_written = 0;
+	capture->frames_dropped = 0;
+	capture->write_failed = false;
+	capture->encoder = std::thread(encode_frames, capture);
+
+	return capture;
+}
+
+static void queue_frame(FrameCapture* capture, const void* pixels)
+{
+	int slot;
+	{
+		std::lock_guard<std::mutex> lock(capture->mutex);
+		if(capture->queue_count == QUEUED_FRAMES)
+		{
+			capture->frames_dropped += 1;
+			return;
+		}
+		slot = (capture->queue_first + capture->queue_count) % QUEUED_FRAMES;
+	}
+
+	// Only this thread adds frames, and the encoder won't touch this slot
+	// until it's counted, so the copy needn't hold the lock.
+	memcpy(capture->queue + slot * capture->frame_size, pixels, capture->frame_size);
+
+	{
+		std::lock_guard<std::mutex> lock(capture->mutex);
+		capture->queue_count += 1;
+	}
+	capture->frame_queued.notify_one();
+}
+
+static void collect_readbacks(FrameCapture* capture, bool wait_for_oldest)
+{
+	while(capture->pending_readbacks > 0)
+	{
+		int slot = (capture->next_readback - capture->pending_readbacks + READBACK_BUFFERS) % READBACK_BUFFERS;
+
+		GLuint64 timeout = (wait_for_oldest) ? FENCE_TIMEOUT : 0;
+		GLenum result = glClientWaitSync(capture->fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+		if(result == GL_TIMEOUT_EXPIRED)
+			break;
+		if(result == GL_WAIT_FAILED)
+		{
+			LOG_ISSUE("OpenGL: waiting on a frame capture readback failed");
+		}
+		glDeleteSync(capture->fences[slot]);
+		capture->fences[slot] = 0;
+		capture->pending_readbacks -= 1;
+		wait_for_oldest = false;
+
+		bind_buffer(GL_PIXEL_PACK_BUFFER, capture->pack_buffers[slot]);
+		void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, capture->frame_size, GL_MAP_READ_BIT);
+		if(pixels != nullptr)
+		{
+			queue_frame(capture, pixels);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		else
+		{
+			capture->frames_dropped += 1;
+		}
+		bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+}
+
+void capture_frame(FrameCapture* capture)
+{
+	// Readbacks are normally long finished by the time they come round again,
+	// but if every buffer is still in use the oldest has to be waited on, and
+	// if even that doesn't free one up, there's nowhere to put this frame.
+	collect_readbacks(capture, capture->pending_readbacks == READBACK_BUFFERS);
+	if(capture->pending_readbacks == READBACK_BUFFERS)
+	{
+		capture->frames_dropped += 1;
+		return;
+	}
+
+	// with a pack buffer bound, this only queues the copy rather than doing it
+	int slot = capture->next_readback;
+	bind_buffer(GL_PIXEL_PACK_BUFFER, capture->pack_buffers[slot]);
+	glReadPixels(0, 0, capture->width, capture->height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	capture->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	capture->next_readback = (slot + 1) % READBACK_BUFFERS;
+	capture->pending_readbacks += 1;
+}
+
+void end_frame_capture(FrameCapture* capture)
+{
+	if(capture == nullptr) return;
+
+	for(int i = 0; i < READBACK_BUFFERS && capture->pending_readbacks > 0; ++i)
+	{
+		collect_readbacks(capture, true);
+	}
+	capture->frames_dropped += capture->pending_readbacks;
+
+	{
+		std::lock_guard<std::mutex> lock(capture->mutex);
+		capture->finished = true;
+	}
+	capture->frame_queued.notify_one();
+	capture->encoder.join();
+
+	if(capture->frames_dropped > 0)
+	{
+		LOG_ISSUE("frame capture fell behind and dropped %i frames", capture->frames_dropped);
+	}
+
+	// go back and fill in how many frames there turned out to be
+	fseek(capture->file, 8, SEEK_SET);
+	fwrite(&capture->frames_written, sizeof capture->frames_written, 1, capture->file);
+	fclose(capture->file);
+
+	for(int i = 0; i < READBACK_BUFFERS; ++i)
+	{
+		glDeleteSync(capture->fences[i]);
+		forget_buffer(capture->pack_buffers[i]);
+	}
+	glDeleteBuffers(READBACK_BUFFERS, capture->pack_buffers);
+	delete[] capture->queue;
+
+	delete capture;
+}
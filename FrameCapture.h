@@ -0,0 +1,27 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include "gl_core_3_3.h"
+
+// Records every frame drawn to a file without holding up rendering. Frames
+// are read back into a ring of pixel pack buffers, which the GPU fills in its
+// own time, and are only mapped a few frames later once their fence has been
+// passed. The pixels are then handed to an encoder thread which does all the
+// compressing and writing.
+//
+// The file starts with the magic "MNGC", a 16-bit width and height, then a
+// 32-bit frame count. Each frame follows as a 32-bit size and the frame's RGB
+// pixels, top row first, XORed with the previous frame's and then run-length
+// encoded. The first frame is XORed with all black.
+
+struct FrameCapture;
+
+FrameCapture* begin_frame_capture(const char* filename, int width, int height);
+
+// waits for the frames still being read back and encoded, then closes the file
+void end_frame_capture(FrameCapture* capture);
+
+// reads back the colour attachment of the bound read framebuffer
+void capture_frame(FrameCapture* capture);
+
+#endif
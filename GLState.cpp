@@ -0,0 +1,251 @@
+#include "GLState.h"
+
+#include "utilities/ArrayMacros.h"
+
+#include <cassert>
+
+// A name no object ever has, so the first bind of anything always goes
+// through. It's all bits set, so arrays of bindings can be filled bytewise.
+#define UNKNOWN_BINDING 0xFFFFFFFFu
+
+namespace
+{
+	enum TextureTarget
+	{
+		TEXTURE_TARGET_2D,
+		TEXTURE_TARGET_2D_ARRAY,
+		TEXTURE_TARGET_COUNT,
+	};
+
+	enum BufferTarget
+	{
+		BUFFER_TARGET_ARRAY,
+		BUFFER_TARGET_UNIFORM,
+		BUFFER_TARGET_PIXEL_PACK,
+		BUFFER_TARGET_PIXEL_UNPACK,
+		BUFFER_TARGET_COUNT,
+	};
+
+	struct UniformBinding
+	{
+		GLuint buffer;
+		GLintptr offset;
+		GLsizeiptr size; // 0 for the whole buffer
+	};
+
+	GLuint program;
+	int active_unit;
+	GLuint textures[GL_STATE_TEXTURE_UNITS][TEXTURE_TARGET_COUNT];
+	GLuint vertex_array;
+	GLuint buffers[BUFFER_TARGET_COUNT];
+	UniformBinding uniform_bindings[GL_STATE_UNIFORM_BINDINGS];
+
+	GLStateCounters counters;
+	bool initialised = false;
+}
+
+static int texture_target_index(GLenum target)
+{
+	switch(target)
+	{
+		case GL_TEXTURE_2D:       return TEXTURE_TARGET_2D;
+		case GL_TEXTURE_2D_ARRAY: return TEXTURE_TARGET_2D_ARRAY;
+	}
+	return -1;
+}
+
+static int buffer_target_index(GLenum target)
+{
+	switch(target)
+	{
+		case GL_ARRAY_BUFFER:        return BUFFER_TARGET_ARRAY;
+		case GL_UNIFORM_BUFFER:      return BUFFER_TARGET_UNIFORM;
+		case GL_PIXEL_PACK_BUFFER:   return BUFFER_TARGET_PIXEL_PACK;
+		case GL_PIXEL_UNPACK_BUFFER: return BUFFER_TARGET_PIXEL_UNPACK;
+	}
+	return -1;
+}
+
+static inline void check_initialised()
+{
+	if(!initialised)
+		reset_gl_state();
+}
+
+void reset_gl_state()
+{
+	program = UNKNOWN_BINDING;
+	active_unit = -1;
+	for(int i = 0; i < GL_STATE_TEXTURE_UNITS; ++i)
+		FILL(textures[i], TEXTURE_TARGET_COUNT, 0xFF);
+	vertex_array = UNKNOWN_BINDING;
+	FILL(buffers, BUFFER_TARGET_COUNT, 0xFF);
+	for(int i = 0; i < GL_STATE_UNIFORM_BINDINGS; ++i)
+		uniform_bindings[i].buffer = UNKNOWN_BINDING;
+	initialised = true;
+}
+
+void use_program(GLuint name)
+{
+	check_initialised();
+	if(program == name)
+	{
+		++counters.redundant_binds;
+		return;
+	}
+	glUseProgram(name);
+	program = name;
+	++counters.program_binds;
+}
+
+static void set_active_unit(int unit)
+{
+	if(active_unit != unit)
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		active_unit = unit;
+	}
+}
+
+void bind_texture(GLenum target, GLuint texture)
+{
+	check_initialised();
+	if(active_unit == -1)
+		set_active_unit(0);
+	bind_texture_unit(active_unit, target, texture);
+}
+
+void bind_texture_unit(int unit, GLenum target, GLuint texture)
+{
+	check_initialised();
+	assert(unit >= 0 && unit < GL_STATE_TEXTURE_UNITS);
+
+	int index = texture_target_index(target);
+	if(index != -1 && textures[unit][index] == texture)
+	{
+		++counters.redundant_binds;
+		return;
+	}
+
+	set_active_unit(unit);
+	glBindTexture(target, texture);
+	if(index != -1)
+		textures[unit][index] = texture;
+	++counters.texture_binds;
+}
+
+void bind_vertex_array(GLuint name)
+{
+	check_initialised();
+	if(vertex_array == name)
+	{
+		++counters.redundant_binds;
+		return;
+	}
+	glBindVertexArray(name);
+	vertex_array = name;
+	++counters.vertex_array_binds;
+}
+
+void bind_buffer(GLenum target, GLuint buffer)
+{
+	check_initialised();
+	int index = buffer_target_index(target);
+	if(index != -1 && buffers[index] == buffer)
+	{
+		++counters.redundant_binds;
+		return;
+	}
+	glBindBuffer(target, buffer);
+	if(index != -1)
+		buffers[index] = buffer;
+	++counters.buffer_binds;
+}
+
+void bind_uniform_buffer_base(GLuint index, GLuint buffer)
+{
+	bind_uniform_buffer_range(index, buffer, 0, 0);
+}
+
+void bind_uniform_buffer_range(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	check_initialised();
+	assert(index < GL_STATE_UNIFORM_BINDINGS);
+
+	UniformBinding& binding = uniform_bindings[index];
+	if(binding.buffer == buffer && binding.offset == offset && binding.size == size)
+	{
+		++counters.redundant_binds;
+		return;
+	}
+
+	if(size == 0)
+		glBindBufferBase(GL_UNIFORM_BUFFER, index, buffer);
+	else
+		glBindBufferRange(GL_UNIFORM_BUFFER, index, buffer, offset, size);
+	binding.buffer = buffer;
+	binding.offset = offset;
+	binding.size = size;
+
+	// binding to an indexed point binds to the generic one as well
+	buffers[BUFFER_TARGET_UNIFORM] = buffer;
+	++counters.buffer_binds;
+}
+
+void forget_program(GLuint name)
+{
+	if(program == name)
+		program = UNKNOWN_BINDING;
+}
+
+void forget_texture(GLuint texture)
+{
+	for(int i = 0; i < GL_STATE_TEXTURE_UNITS; ++i)
+	{
+		for(int j = 0; j < TEXTURE_TARGET_COUNT; ++j)
+		{
+			if(textures[i][j] == texture)
+				textures[i][j] = UNKNOWN_BINDING;
+		}
+	}
+}
+
+void forget_vertex_array(GLuint name)
+{
+	if(vertex_array == name)
+		vertex_array = UNKNOWN_BINDING;
+}
+
+void forget_buffer(GLuint buffer)
+{
+	for(int i = 0; i < BUFFER_TARGET_COUNT; ++i)
+	{
+		if(buffers[i] == buffer)
+			buffers[i] = UNKNOWN_BINDING;
+	}
+	for(int i = 0; i < GL_STATE_UNIFORM_BINDINGS; ++i)
+	{
+		if(uniform_bindings[i].buffer == buffer)
+			uniform_bindings[i].buffer = UNKNOWN_BINDING;
+	}
+}
+
+void count_draw()
+{
+	++counters.draws;
+}
+
+void count_upload(size_t bytes)
+{
+	counters.upload_bytes += bytes;
+}
+
+const GLStateCounters& gl_state_counters()
+{
+	return counters;
+}
+
+void reset_gl_state_counters()
+{
+	CLEAR(&counters, 1);
+}
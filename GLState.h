@@ -0,0 +1,52 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include "gl_core_3_3.h"
+
+#include <cstddef>
+
+// Keeps a shadow copy of the bindings the renderer changes most, so setting
+// one to what it already is never reaches the driver. Everything that binds
+// programs, textures, vertex arrays or the buffers below should go through
+// here, otherwise the shadow copy goes stale. Deleted objects must also be
+// forgotten, since GL unbinds them and a new object may then reuse the name.
+
+#define GL_STATE_TEXTURE_UNITS    4
+#define GL_STATE_UNIFORM_BINDINGS 2
+
+// calls made and skipped since the counters were last reset
+struct GLStateCounters
+{
+	int draws;
+	int program_binds;
+	int texture_binds;
+	int vertex_array_binds;
+	int buffer_binds;
+	int redundant_binds;
+	size_t upload_bytes;
+};
+
+// forgets every binding, for when the context's state is unknown
+void reset_gl_state();
+
+void use_program(GLuint program);
+void bind_texture(GLenum target, GLuint texture); // to the active unit
+void bind_texture_unit(int unit, GLenum target, GLuint texture);
+void bind_vertex_array(GLuint vertex_array);
+
+// GL_ARRAY_BUFFER, GL_UNIFORM_BUFFER and the pixel buffer targets are cached
+void bind_buffer(GLenum target, GLuint buffer);
+void bind_uniform_buffer_base(GLuint index, GLuint buffer);
+void bind_uniform_buffer_range(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+void forget_program(GLuint program);
+void forget_texture(GLuint texture);
+void forget_vertex_array(GLuint vertex_array);
+void forget_buffer(GLuint buffer);
+
+void count_draw();
+void count_upload(size_t bytes);
+const GLStateCounters& gl_state_counters();
+void reset_gl_state_counters();
+
+#endif
@@ -1,65 +1,282 @@
 #include "Game.h"
 #include "Input.h"
+#include "FixedTimestep.h"
+#include "EntityPool.h"
 
 #include "utilities/Random.h"
+#include "utilities/ArrayMacros.h"
+
+#include <cstring>
+
+// how long each step of the water and lava colour cycles lasts, and how long
+// it takes the screen to fade in from black after a map is loaded, in seconds
+#define CYCLE_STEP_TIME 0.125
+#define FADE_IN_TIME    0.5
+
+#define STEP_TIME (1.0 / GAME_BOY_FRAME_RATE)
+
+// room for plenty more moving things than there are sprites to draw them with
+#define ENTITY_CAPACITY 1024
+
+#define WATER_PALETTE 1
+#define LAVA_PALETTE  2
 
 namespace Game {
 
 namespace
 {
 	Tilemap tilemap;
-	Sprite sprites[MAX_SPRITES];
+	EntityPool entities;
+
+	// where the background was as of the step before, and the entities picked
+	// to be drawn as sprites
+	byte_t previous_scroll_x = 0;
+	byte_t previous_scroll_y = 0;
+	Sprite drawn_sprites[MAX_SPRITES];
+	int drawn_entities[MAX_SPRITES];
+
+	// Palette animation is done on the base palettes, which the palettes the
+	// renderer sees are then faded from.
+	PaletteRam base_palettes;
+	PaletteRam palettes;
+	double cycle_time = 0.0;
+	double fade_time = 0.0;
+
+	byte_t scroll_x = 0;
+	byte_t scroll_y = 0;
+
+	// With more than ten sprites on a line, moving where the OAM scan starts
+	// every step has the ones left out flicker rather than just not show.
+	bool sprite_flicker = true;
+	byte_t sprite_scan_start = 0;
 
 	bool loading_map = false;
+
+	// the fixed part of a saved state, which the tilemap's planes and then
+	// the entities follow
+	struct SavedState
+	{
+		word_t base_colors[2 * PALETTE_COUNT][COLORS_PER_PALETTE];
+		word_t colors[2 * PALETTE_COUNT][COLORS_PER_PALETTE];
+		double cycle_time;
+		double fade_time;
+		byte_t scroll_x, scroll_y;
+		byte_t previous_scroll_x, previous_scroll_y;
+		byte_t sprite_scan_start;
+		bool loading_map;
+	};
 }
 
 void Initialise()
 {
 	tilemap = load_tilemap("test_map.map");
 
-	// initialise sprites
+	// initialise entities
 	{
+		entities = create_entity_pool(ENTITY_CAPACITY);
+
 		random::sow(7);
 		for(int i = 0; i < MAX_SPRITES; ++i)
 		{
-			Sprite& sprite = sprites[i];
-			sprite.tile_number = random::reap_integer(0, 127);
-			sprite.attribute = SPRITE_HORIZONTAL_FLIP | SPRITE_VERTICAL_FLIP;
-			sprite.position_x = random::reap_integer(0, 255);
-			sprite.position_y = random::reap_integer(0, 255);
+			byte_t tile_number = random::reap_integer(0, 127);
+			byte_t x = random::reap_integer(0, 255);
+			byte_t y = random::reap_integer(0, 255);
+			spawn_entity(entities, x, y, tile_number, SPRITE_HORIZONTAL_FLIP | SPRITE_VERTICAL_FLIP);
 		}
 	}
 
+	// set up palettes
+	{
+		reset_palettes(base_palettes);
+
+		const word_t water[COLORS_PER_PALETTE] =
+		{
+			rgb555(0, 2, 8), rgb555(4, 10, 24), rgb555(8, 16, 28), rgb555(16, 24, 31),
+		};
+		set_palette(base_palettes, WATER_PALETTE, water);
+
+		const word_t lava[COLORS_PER_PALETTE] =
+		{
+			rgb555(8, 0, 0), rgb555(24, 4, 0), rgb555(31, 12, 0), rgb555(31, 24, 4),
+		};
+		set_palette(base_palettes, LAVA_PALETTE, lava);
+
+		palettes = base_palettes;
+	}
+
 	loading_map = true;
 }
 
 void Terminate()
 {
 	unload_tilemap(tilemap);
+	destroy_entity_pool(entities);
+}
+
+void Update(byte_t input_state)
+{
+	previous_scroll_x = scroll_x;
+	previous_scroll_y = scroll_y;
+
+	// input pushes everything one pixel along
+	{
+		int push_x = 0;
+		int push_y = 0;
+		if(input_state & INPUT_LEFT)  push_x -= 0x100;
+		if(input_state & INPUT_RIGHT) push_x += 0x100;
+		if(input_state & INPUT_UP)    push_y -= 0x100;
+		if(input_state & INPUT_DOWN)  push_y += 0x100;
+		move_entities(entities, push_x, push_y);
+	}
+
+	if(sprite_flicker)
+	{
+		sprite_scan_start = (sprite_scan_start + 1) % MAX_SPRITES;
+	}
+
+	// animate palettes
+	{
+		cycle_time += STEP_TIME;
+		while(cycle_time >= CYCLE_STEP_TIME)
+		{
+			cycle_palette_colors(base_palettes, WATER_PALETTE, 1, 3);
+			cycle_palette_colors(base_palettes, LAVA_PALETTE, 1, 3);
+			cycle_time -= CYCLE_STEP_TIME;
+		}
+
+		if(loading_map)
+			fade_time = 0.0;
+		else if(fade_time < FADE_IN_TIME)
+			fade_time += STEP_TIME;
+
+		double fade = 1.0 - fade_time / FADE_IN_TIME;
+		int amount = (fade > 0.0) ? static_cast<int>(31.0 * fade + 0.5) : 0;
+		blend_palettes(palettes, base_palettes, rgb555(0, 0, 0), amount);
+	}
+}
+
+static inline byte_t blend_position(byte_t from, byte_t to, double interpolation)
+{
+	// positions wrap around, so go whichever way round is shorter
+	int distance = static_cast<signed char>(to - from);
+	double rounding = (distance < 0) ? -0.5 : 0.5;
+	int offset = static_cast<int>(distance * interpolation + rounding);
+	return static_cast<byte_t>(from + offset);
 }
 
-GameState Update(byte_t input_state, double delta_time)
+GameState Get_State(double interpolation)
 {
-	for(int i = 0; i < MAX_SPRITES; ++i)
+	// Only so many sprites fit in OAM, so those are the first entities found
+	// on screen, and the rest of OAM is hidden below the bottom of it.
+	int visible = select_visible_entities(entities, drawn_entities, MAX_SPRITES);
+	for(int i = 0; i < visible; ++i)
 	{
-		if(input_state & INPUT_LEFT)  --sprites[i].position_x;
-		if(input_state & INPUT_RIGHT) ++sprites[i].position_x;
-		if(input_state & INPUT_UP)    --sprites[i].position_y;
-		if(input_state & INPUT_DOWN)  ++sprites[i].position_y;
+		int entity = drawn_entities[i];
+		Sprite& drawn = drawn_sprites[i];
+		byte_t from_x = entities.previous_x[entity] >> 8;
+		byte_t from_y = entities.previous_y[entity] >> 8;
+		drawn.position_x = blend_position(from_x, entities.position_x[entity] >> 8, interpolation);
+		drawn.position_y = blend_position(from_y, entities.position_y[entity] >> 8, interpolation);
+		drawn.tile_number = entities.tile_number[entity];
+		drawn.attribute = entities.attribute[entity];
+	}
+	for(int i = visible; i < MAX_SPRITES; ++i)
+	{
+		drawn_sprites[i] = {};
+		drawn_sprites[i].position_y = 0xFF;
 	}
 
 	GameState state = {};
-	state.sprites = sprites;
+	state.sprites = drawn_sprites;
 	state.tilemap = &tilemap;
+	state.palettes = &palettes;
+	state.scroll_x = blend_position(previous_scroll_x, scroll_x, interpolation);
+	state.scroll_y = blend_position(previous_scroll_y, scroll_y, interpolation);
+	state.sprite_scan_start = sprite_scan_start;
 	state.load_map = loading_map;
+	state.background_tileset = "Tile Atlas.png";
+	state.sprite_tileset = "Tile Atlas.png";
+	loading_map = false;
+
+	return state;
+}
+
+size_t Saved_State_Size()
+{
+	return sizeof(SavedState) + 2 * tilemap.columns * tilemap.rows + saved_entities_size(entities);
+}
 
-	if(loading_map)
+void Save_State(void* state)
+{
+	SavedState saved;
+	CLEAR(&saved, 1); // so padding is the same every time and XORs to nothing
+	COPY(&base_palettes.colors[0][0], &saved.base_colors[0][0], PALETTE_RAM_COLORS);
+	COPY(&palettes.colors[0][0], &saved.colors[0][0], PALETTE_RAM_COLORS);
+	saved.cycle_time = cycle_time;
+	saved.fade_time = fade_time;
+	saved.scroll_x = scroll_x;
+	saved.scroll_y = scroll_y;
+	saved.previous_scroll_x = previous_scroll_x;
+	saved.previous_scroll_y = previous_scroll_y;
+	saved.sprite_scan_start = sprite_scan_start;
+	saved.loading_map = loading_map;
+
+	byte_t* bytes = static_cast<byte_t*>(state);
+	int tile_count = tilemap.columns * tilemap.rows;
+	COPY(&saved, reinterpret_cast<SavedState*>(bytes), 1);
+	COPY(tilemap.tiles, bytes + sizeof saved, tile_count);
+	COPY(tilemap.attributes, bytes + sizeof saved + tile_count, tile_count);
+	save_entities(entities, bytes + sizeof saved + 2 * tile_count);
+}
+
+bool Load_State(const void* state)
+{
+	// check what can be wrong before any of the game is changed
+	const byte_t* bytes = static_cast<const byte_t*>(state);
+	const byte_t* saved_entities = bytes + sizeof(SavedState) + 2 * tilemap.columns * tilemap.rows;
+	if(!can_load_entities(entities, saved_entities))
+		return false;
+
+	SavedState saved;
+	COPY(reinterpret_cast<const SavedState*>(bytes), &saved, 1);
+
+	COPY(&saved.base_colors[0][0], &base_palettes.colors[0][0], PALETTE_RAM_COLORS);
+	cycle_time = saved.cycle_time;
+	fade_time = saved.fade_time;
+	scroll_x = saved.scroll_x;
+	scroll_y = saved.scroll_y;
+	previous_scroll_x = saved.previous_scroll_x;
+	previous_scroll_y = saved.previous_scroll_y;
+	sprite_scan_start = saved.sprite_scan_start;
+	loading_map = saved.loading_map;
+
+	// set these one by one, so that only what's different is marked changed
+	for(int i = 0; i < 2 * PALETTE_COUNT; ++i)
 	{
-		state.atlas_name = "Tile Atlas.png";
-		loading_map = false;
+		for(int j = 0; j < COLORS_PER_PALETTE; ++j)
+		{
+			set_palette_color(palettes, i, j, saved.colors[i][j]);
+		}
 	}
 
-	return state;
+	// likewise only rows of the tilemap that differ
+	const byte_t* tiles = bytes + sizeof saved;
+	const byte_t* attributes = tiles + tilemap.columns * tilemap.rows;
+	for(int y = 0; y < tilemap.rows; ++y)
+	{
+		int offset = y * tilemap.columns;
+		size_t row_size = tilemap.columns;
+		if(memcmp(tilemap.tiles + offset, tiles + offset, row_size) == 0 &&
+			memcmp(tilemap.attributes + offset, attributes + offset, row_size) == 0)
+			continue;
+
+		COPY(tiles + offset, tilemap.tiles + offset, row_size);
+		COPY(attributes + offset, tilemap.attributes + offset, row_size);
+		mark_tiles_dirty(tilemap, 0, y, tilemap.columns, 1);
+	}
+
+	load_entities(entities, saved_entities);
+	return true;
 }
 
 } // namespace Game
@@ -3,6 +3,9 @@
 
 #include "Tilemap.h"
 #include "Sprite.h"
+#include "PaletteRam.h"
+
+#include <cstddef>
 
 namespace Game {
 
@@ -10,14 +13,37 @@ struct GameState
 {
 	Sprite* sprites;
 	Tilemap* tilemap;
+	PaletteRam* palettes;
+
+	// background scroll registers (SCX/SCY), in pixels
+	byte_t scroll_x, scroll_y;
+
+	// the sprite the renderer's OAM scan starts from, see OamScan.h
+	byte_t sprite_scan_start;
 
 	bool load_map;
-	const char* atlas_name;
+
+	// pattern images for the background and sprites, which may be the same
+	const char* background_tileset;
+	const char* sprite_tileset;
 };
 
 void Initialise();
 void Terminate();
-GameState Update(byte_t input_state, double delta_time);
+
+// advances the game by one fixed step of 1 / GAME_BOY_FRAME_RATE seconds
+void Update(byte_t input_state);
+
+// The state to draw, part way between the last two steps, where 0 is the
+// older step and 1 would be the latest. Only positions are blended, and they
+// still land on whole pixels.
+GameState Get_State(double interpolation);
+
+// Everything that changes as the game runs, as one block of bytes, which is
+// saved every step for rewinding. Its size only changes with the map's.
+size_t Saved_State_Size();
+void Save_State(void* state);
+bool Load_State(const void* state); // false, changing nothing, if it's corrupt
 
 } // namespace Game
 
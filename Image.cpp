@@ -0,0 +1,40 @@
+#include "Image.h"
+
+#include "utilities/stb_image.h"
+#include "utilities/Logging.h"
+#include "utilities/StringManipulation.h"
+
+#include <cstdio>
+
+void* load_image(const char* filename, int* width, int* height, int required_components)
+{
+	// append file name to base path
+	char path[128];
+	concatenate("resources/images/", filename, path);
+
+	// read in file
+	FILE* file = fopen(path, "rb");
+	if(file == nullptr)
+	{
+		LOG_ISSUE("%s : file handle could not be opened", path);
+		return nullptr;
+	}
+
+	int num_components;
+	unsigned char* data = stbi_load_from_file(file, width, height, &num_components, required_components);
+	if(data == nullptr)
+	{
+		LOG_ISSUE("%s STB IMAGE ERROR: %s", path, stbi_failure_reason());
+		fclose(file);
+		return nullptr;
+	}
+
+	fclose(file);
+
+	return data;
+}
+
+void unload_image(void* data)
+{
+	stbi_image_free(data);
+}
\ No newline at end of file
@@ -0,0 +1,12 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+// Loads images from resources/images without touching the GPU, so anything
+// that only needs the pixels, like the software renderer, needn't link GL.
+
+// Pixels come out with required_components bytes each, converted from
+// whatever the file holds, or as many as the file has if that's 0.
+void* load_image(const char* file_name, int* width, int* height, int required_components);
+void unload_image(void* data);
+
+#endif
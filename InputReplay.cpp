@@ -0,0 +1,155 @@
+#include "InputReplay.h"
+
+#include "utilities/ArrayMacros.h"
+#include "utilities/FileHandling.h"
+#include "utilities/Logging.h"
+#include "utilities/RunLength.h"
+
+#include <climits>
+#include <cstdint>
+
+#define REPLAY_FILE_MAGIC   0x524E474D // "MNGR"
+#define REPLAY_FILE_VERSION 1
+
+// about a minute of frames at first, doubling as needed
+#define INITIAL_CAPACITY 4096
+
+struct ReplayFileHeader
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t flags;
+	uint32_t frame_count;
+	uint32_t inputs_size;
+	uint32_t steps_size;
+};
+
+void destroy_input_replay(InputReplay& replay)
+{
+	delete[] replay.inputs;
+	delete[] replay.steps;
+	replay = {};
+}
+
+static void reserve_frames(InputReplay& replay, int capacity)
+{
+	if(capacity <= replay.capacity) return;
+
+	byte_t* inputs = new byte_t[capacity];
+	byte_t* steps = new byte_t[capacity];
+	COPY(replay.inputs, inputs, replay.frame_count);
+	COPY(replay.steps, steps, replay.frame_count);
+	delete[] replay.inputs;
+	delete[] replay.steps;
+
+	replay.inputs = inputs;
+	replay.steps = steps;
+	replay.capacity = capacity;
+}
+
+void record_input(InputReplay& replay, byte_t input_state, int steps)
+{
+	if(replay.frame_count == replay.capacity)
+	{
+		int capacity = (replay.capacity > 0) ? 2 * replay.capacity : INITIAL_CAPACITY;
+		reserve_frames(replay, capacity);
+	}
+
+	replay.inputs[replay.frame_count] = input_state;
+	replay.steps[replay.frame_count] = static_cast<byte_t>(steps);
+	replay.frame_count += 1;
+}
+
+void save_input_replay(const InputReplay& replay, const char* filename)
+{
+	size_t bound = run_length_bound(replay.frame_count);
+	size_t buffer_size = sizeof(ReplayFileHeader) + 2 * bound;
+	byte_t* buffer = new byte_t[buffer_size];
+
+	byte_t* inputs = buffer + sizeof(ReplayFileHeader);
+	size_t inputs_size = run_length_encode(replay.inputs, replay.frame_count, inputs);
+	byte_t* steps = inputs + inputs_size;
+	size_t steps_size = run_length_encode(replay.steps, replay.frame_count, steps);
+
+	ReplayFileHeader header = {};
+	header.magic = REPLAY_FILE_MAGIC;
+	header.version = REPLAY_FILE_VERSION;
+	header.frame_count = replay.frame_count;
+	header.inputs_size = static_cast<uint32_t>(inputs_size);
+	header.steps_size = static_cast<uint32_t>(steps_size);
+	COPY(&header, reinterpret_cast<ReplayFileHeader*>(buffer), 1);
+
+	size_t size = sizeof header + inputs_size + steps_size;
+	save_binary_file(buffer, size, filename);
+	delete[] buffer;
+}
+
+bool load_input_replay(InputReplay& replay, const char* filename)
+{
+	void* data = nullptr;
+	size_t size = load_binary_file(&data, filename);
+	if(size == 0)
+	{
+		LOG_ISSUE("couldn't load input replay %s", filename);
+		return false;
+	}
+	const byte_t* file = static_cast<const byte_t*>(data);
+
+	ReplayFileHeader header;
+	bool valid = size >= sizeof header;
+	if(valid)
+	{
+		COPY(reinterpret_cast<const ReplayFileHeader*>(file), &header, 1);
+		valid = header.magic == REPLAY_FILE_MAGIC && header.version == REPLAY_FILE_VERSION &&
+			header.frame_count <= INT_MAX &&
+			sizeof header + static_cast<size_t>(header.inputs_size) + header.steps_size <= size;
+	}
+	if(valid)
+	{
+		// both planes have to hold exactly a byte per frame, which is checked
+		// before allocating anything, so a bad count can't ask for too much
+		const byte_t* inputs = file + sizeof header;
+		const byte_t* steps = inputs + header.inputs_size;
+		valid = run_length_decoded_size(inputs, header.inputs_size) == header.frame_count &&
+			run_length_decoded_size(steps, header.steps_size) == header.frame_count;
+	}
+	if(!valid)
+	{
+		LOG_ISSUE("%s isn't an input replay this version can play", filename);
+		delete[] static_cast<char*>(data);
+		return false;
+	}
+
+	destroy_input_replay(replay);
+	reserve_frames(replay, static_cast<int>(header.frame_count));
+
+	const byte_t* inputs = file + sizeof header;
+	const byte_t* steps = inputs + header.inputs_size;
+	size_t frames = header.frame_count;
+	bool decoded = frames == 0 ||
+		(run_length_decode(inputs, header.inputs_size, replay.inputs, frames) == frames &&
+		run_length_decode(steps, header.steps_size, replay.steps, frames) == frames);
+	delete[] static_cast<char*>(data);
+
+	if(!decoded)
+	{
+		LOG_ISSUE("input replay %s is corrupt", filename);
+		destroy_input_replay(replay);
+		return false;
+	}
+
+	replay.frame_count = header.frame_count;
+	replay.position = 0;
+	return true;
+}
+
+bool play_input(InputReplay& replay, byte_t* input_state, int* steps)
+{
+	if(replay.position >= replay.frame_count)
+		return false;
+
+	*input_state = replay.inputs[replay.position];
+	*steps = replay.steps[replay.position];
+	replay.position += 1;
+	return true;
+}
@@ -0,0 +1,37 @@
+#ifndef INPUT_REPLAY_H
+#define INPUT_REPLAY_H
+
+#include "GameBoyTypes.h"
+
+// Records the input state and how many fixed game steps ran for each frame,
+// which is everything needed to play a session back exactly, provided it's
+// played from the same starting point; replays always start from the game
+// being initialised.
+//
+// Files start with the magic "MNGR", a 16-bit version and 16-bit flags, the
+// frame count and then the stored size of each of the two planes that follow,
+// all 32-bit. The planes are every frame's input state, then every frame's
+// step count, each one byte per frame and run-length encoded. Input is held
+// for many frames at a time, so laying the planes out separately keeps those
+// runs intact.
+
+struct InputReplay
+{
+	byte_t* inputs;
+	byte_t* steps;
+	int frame_count;
+	int capacity;
+	int position; // the next frame to play back
+};
+
+void destroy_input_replay(InputReplay& replay);
+
+void record_input(InputReplay& replay, byte_t input_state, int steps);
+void save_input_replay(const InputReplay& replay, const char* filename);
+
+bool load_input_replay(InputReplay& replay, const char* filename);
+
+// returns false once every frame has been played
+bool play_input(InputReplay& replay, byte_t* input_state, int* steps);
+
+#endif
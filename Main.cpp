@@ -8,6 +8,7 @@
 #include <Windows.h>
 
 #include <cwchar>
+#include <cstring>
 
 #if defined(NDEBUG)
 #define PRINT_TO_CONSOLE false
@@ -78,6 +79,31 @@ LONG WINAPI unhandled_exception_filter(
 	return EXCEPTION_EXECUTE_HANDLER;
 }
 
+// Takes "-record file" to record input to a file, or "-replay file" to play
+// a recording back. File names can't have spaces in them.
+static void parse_command_line(char* command_line)
+{
+	const char* delimiters = " \t";
+	char* context = nullptr;
+	for(char* option = strtok_s(command_line, delimiters, &context); option;
+		option = strtok_s(nullptr, delimiters, &context))
+	{
+		char* argument = strtok_s(nullptr, delimiters, &context);
+		if(argument == nullptr)
+		{
+			LOG_ISSUE("command line option %s needs a file name after it", option);
+			break;
+		}
+
+		if(strcmp(option, "-record") == 0)
+			record_input_to(argument);
+		else if(strcmp(option, "-replay") == 0)
+			replay_input_from(argument);
+		else
+			LOG_ISSUE("unknown command line option %s", option);
+	}
+}
+
 int WINAPI WinMain(
 	_In_ HINSTANCE instance,
 	_In_opt_ HINSTANCE previous_instance,
@@ -85,7 +111,6 @@ int WINAPI WinMain(
 	_In_ int show_mode)
 {
 	UNREFERENCED_PARAMETER(previous_instance);
-	UNREFERENCED_PARAMETER(command_line);
 
 	SetUnhandledExceptionFilter(unhandled_exception_filter);
 
@@ -95,6 +120,7 @@ int WINAPI WinMain(
 	int main_return = 0;
 	if(create_window(instance))
 	{
+		parse_command_line(command_line);
 		show_window(show_mode);
 		main_return = message_loop();
 	}
@@ -2,6 +2,7 @@
 #define MESH_H
 
 #include "gl_core_3_3.h"
+#include "GLState.h"
 
 struct Mesh
 {
@@ -12,6 +13,8 @@ struct Mesh
 
 inline void destroy_mesh(const Mesh& mesh)
 {
+	forget_buffer(mesh.buffers[0]);
+	forget_vertex_array(mesh.vertex_array);
 	glDeleteBuffers(sizeof(mesh.buffers) / sizeof(*mesh.buffers), mesh.buffers);
 	glDeleteVertexArrays(1, &mesh.vertex_array);
 }
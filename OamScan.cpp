@@ -0,0 +1,69 @@
+#include "OamScan.h"
+
+#include "utilities/ArrayMacros.h"
+
+#define SPRITE_HEIGHT 8
+
+void scan_oam(const Sprite sprites[MAX_SPRITES], int line_count, int first_sprite, ScanlineSprites& lines)
+{
+	if(line_count > MAX_SCAN_LINES)
+		line_count = MAX_SCAN_LINES;
+	lines.line_count = line_count;
+
+	// Pick which rows of each sprite make it in, going through OAM in scan
+	// order and counting how many sprites each line has taken so far.
+	CLEAR(lines.counts, line_count);
+	CLEAR_ARRAY(lines.visible_rows);
+	for(int n = 0; n < MAX_SPRITES; ++n)
+	{
+		int i = (first_sprite + n) % MAX_SPRITES;
+		int top = sprites[i].position_y;
+		for(int row = 0; row < SPRITE_HEIGHT && top + row < line_count; ++row)
+		{
+			int line = top + row;
+			if(lines.counts[line] < MAX_SPRITES_PER_LINE)
+			{
+				lines.counts[line] += 1;
+				lines.visible_rows[i] |= 1 << row;
+			}
+		}
+	}
+
+	// Sort all the sprites by X with a counting sort, which keeps sprites at
+	// the same X in OAM order.
+	{
+		int starts[256] = {};
+		for(int i = 0; i < MAX_SPRITES; ++i)
+		{
+			starts[sprites[i].position_x] += 1;
+		}
+		int total = 0;
+		for(int x = 0; x < 256; ++x)
+		{
+			int count = starts[x];
+			starts[x] = total;
+			total += count;
+		}
+		for(int i = 0; i < MAX_SPRITES; ++i)
+		{
+			lines.order[starts[sprites[i].position_x]++] = i;
+		}
+	}
+
+	// Then deal the picked rows out to their lines in that order, so every
+	// line's list comes out already sorted.
+	CLEAR(lines.counts, line_count);
+	for(int n = 0; n < MAX_SPRITES; ++n)
+	{
+		int i = lines.order[n];
+		int top = sprites[i].position_y;
+		for(int row = 0, rows = lines.visible_rows[i]; rows != 0; ++row, rows >>= 1)
+		{
+			if(rows & 1)
+			{
+				int line = top + row;
+				lines.sprites[line][lines.counts[line]++] = i;
+			}
+		}
+	}
+}
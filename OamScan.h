@@ -0,0 +1,33 @@
+#ifndef OAM_SCAN_H
+#define OAM_SCAN_H
+
+#include "Sprite.h"
+
+// Works out which sprites the hardware would draw on each line, all lines in
+// one go, before either renderer draws anything. For each line, the first
+// MAX_SPRITES_PER_LINE sprites on it in OAM order are picked and the rest are
+// dropped. Among those picked, the one with the smallest X is drawn over the
+// others, and sprites at the same X go by OAM order.
+
+#define MAX_SPRITES_PER_LINE 10
+#define MAX_SCAN_LINES       256
+
+struct ScanlineSprites
+{
+	// for each line, the sprites drawn on it, highest priority first
+	byte_t counts[MAX_SCAN_LINES];
+	byte_t sprites[MAX_SCAN_LINES][MAX_SPRITES_PER_LINE];
+	int line_count;
+
+	// every sprite, highest priority first, and which of its rows are drawn,
+	// with bit 0 being its top row
+	byte_t order[MAX_SPRITES];
+	byte_t visible_rows[MAX_SPRITES];
+};
+
+// Looks through OAM starting at first_sprite, rather than 0, and wrapping
+// around. Moving the start along each frame has the sprites that are dropped
+// take turns, so they flicker instead of disappearing.
+void scan_oam(const Sprite sprites[MAX_SPRITES], int line_count, int first_sprite, ScanlineSprites& lines);
+
+#endif
@@ -0,0 +1,79 @@
+#include "PaletteRam.h"
+
+#include <cassert>
+
+// the darkest, middle and lightest shades used in the tile atlas, over black
+const word_t default_palette[COLORS_PER_PALETTE] =
+{
+	0x0000,
+	0x2889,
+	0x29AF,
+	0x42DC,
+};
+
+void reset_palettes(PaletteRam& ram)
+{
+	for(int i = 0; i < 2 * PALETTE_COUNT; ++i)
+	{
+		for(int j = 0; j < COLORS_PER_PALETTE; ++j)
+			ram.colors[i][j] = default_palette[j];
+	}
+	ram.dirty = ~0ull;
+}
+
+void set_palette_color(PaletteRam& ram, int palette, int index, word_t color)
+{
+	assert(palette >= 0 && palette < 2 * PALETTE_COUNT);
+	assert(index >= 0 && index < COLORS_PER_PALETTE);
+
+	// writing the colour that's already there isn't a change
+	if(ram.colors[palette][index] == color) return;
+
+	ram.colors[palette][index] = color;
+	ram.dirty |= 1ull << (palette * COLORS_PER_PALETTE + index);
+}
+
+void set_palette(PaletteRam& ram, int palette, const word_t colors[COLORS_PER_PALETTE])
+{
+	for(int i = 0; i < COLORS_PER_PALETTE; ++i)
+		set_palette_color(ram, palette, i, colors[i]);
+}
+
+void cycle_palette_colors(PaletteRam& ram, int palette, int first, int count)
+{
+	assert(first >= 0 && first + count <= COLORS_PER_PALETTE);
+	if(count < 2) return;
+
+	word_t* colors = ram.colors[palette];
+	word_t last = colors[first + count - 1];
+	for(int i = first + count - 1; i > first; --i)
+		set_palette_color(ram, palette, i, colors[i - 1]);
+	set_palette_color(ram, palette, first, last);
+}
+
+static word_t blend_color(word_t from, word_t to, int amount)
+{
+	word_t result = 0;
+	for(int shift = 0; shift < 15; shift += 5)
+	{
+		int a = (from >> shift) & 31;
+		int b = (to >> shift) & 31;
+		int channel = a + (b - a) * amount / 31;
+		result |= channel << shift;
+	}
+	return result;
+}
+
+void blend_palettes(PaletteRam& ram, const PaletteRam& base, word_t color, int amount)
+{
+	for(int i = 0; i < 2 * PALETTE_COUNT; ++i)
+	{
+		for(int j = 0; j < COLORS_PER_PALETTE; ++j)
+			set_palette_color(ram, i, j, blend_color(base.colors[i][j], color, amount));
+	}
+}
+
+void clear_dirty_colors(PaletteRam& ram)
+{
+	ram.dirty = 0;
+}
@@ -0,0 +1,46 @@
+#ifndef PALETTE_RAM_H
+#define PALETTE_RAM_H
+
+#include "GameBoyTypes.h"
+
+// Emulates CGB palette RAM: eight background palettes followed by eight
+// object palettes, each of four RGB555 colours with red in the low five bits,
+// then green, then blue. Colours changed through the functions below are
+// marked with one bit each, so a renderer only needs to re-send those.
+
+#define PALETTE_COUNT      8
+#define COLORS_PER_PALETTE 4
+
+#define OBJECT_PALETTES      PALETTE_COUNT // index of object palette 0
+#define PALETTE_RAM_COLORS   (2 * PALETTE_COUNT * COLORS_PER_PALETTE)
+
+struct PaletteRam
+{
+	word_t colors[2 * PALETTE_COUNT][COLORS_PER_PALETTE];
+	uint64_t dirty; // bit n is colors[n / 4][n % 4]
+};
+
+extern const word_t default_palette[COLORS_PER_PALETTE];
+
+static inline word_t rgb555(int red, int green, int blue)
+{
+	return static_cast<word_t>(red | green << 5 | blue << 10);
+}
+
+void reset_palettes(PaletteRam& ram);
+
+void set_palette_color(PaletteRam& ram, int palette, int index, word_t color);
+void set_palette(PaletteRam& ram, int palette, const word_t colors[COLORS_PER_PALETTE]);
+
+// Rotates count colours of a palette starting at first along by one place,
+// for animating things like water and lava by cycling their colours.
+void cycle_palette_colors(PaletteRam& ram, int palette, int first, int count);
+
+// Blends every colour from one palette RAM towards a single colour, where an
+// amount of 0 is unchanged and 31 is entirely that colour. Fading to black or
+// white and flashing are all done by blending from the same base palettes.
+void blend_palettes(PaletteRam& ram, const PaletteRam& base, word_t color, int amount);
+
+void clear_dirty_colors(PaletteRam& ram);
+
+#endif
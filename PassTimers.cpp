@@ -0,0 +1,72 @@
+#include "PassTimers.h"
+
+#include "utilities/ArrayMacros.h"
+
+#include <cassert>
+
+PassTimers create_pass_timers()
+{
+	PassTimers timers = {};
+	for(int i = 0; i < TIMER_QUERY_FRAMES; ++i)
+	{
+		glGenQueries(MAX_TIMED_PASSES, timers.queries[i]);
+	}
+	timers.active_pass = -1;
+	return timers;
+}
+
+void destroy_pass_timers(PassTimers& timers)
+{
+	for(int i = 0; i < TIMER_QUERY_FRAMES; ++i)
+	{
+		glDeleteQueries(MAX_TIMED_PASSES, timers.queries[i]);
+		CLEAR_ARRAY(timers.queries[i]);
+	}
+}
+
+void begin_timer_frame(PassTimers& timers)
+{
+	assert(timers.active_pass == -1);
+
+	// The queries about to be reused were issued the longest ago. One that
+	// still isn't done is dropped rather than waited on; beginning it again
+	// simply discards its pending result.
+	timers.frame = (timers.frame + 1) % TIMER_QUERY_FRAMES;
+	for(int pass = 0; pass < MAX_TIMED_PASSES; ++pass)
+	{
+		if(!timers.issued[timers.frame][pass])
+		{
+			timers.pass_times[pass] = 0.0;
+			continue;
+		}
+
+		GLuint query = timers.queries[timers.frame][pass];
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if(available)
+		{
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+			timers.pass_times[pass] = nanoseconds / 1.0e6;
+		}
+		timers.issued[timers.frame][pass] = false;
+	}
+}
+
+void begin_pass_timer(PassTimers& timers, int pass)
+{
+	assert(pass >= 0 && pass < MAX_TIMED_PASSES);
+	assert(timers.active_pass == -1);
+
+	glBeginQuery(GL_TIME_ELAPSED, timers.queries[timers.frame][pass]);
+	timers.issued[timers.frame][pass] = true;
+	timers.active_pass = pass;
+}
+
+void end_pass_timer(PassTimers& timers)
+{
+	assert(timers.active_pass != -1);
+
+	glEndQuery(GL_TIME_ELAPSED);
+	timers.active_pass = -1;
+}
@@ -0,0 +1,35 @@
+#ifndef PASS_TIMERS_H
+#define PASS_TIMERS_H
+
+#include "gl_core_3_3.h"
+
+// Measures how long the GPU spends on each render pass with GL_TIME_ELAPSED
+// queries. Results are only read back once they're available, a couple of
+// frames after they were issued, so that the CPU never waits on the GPU to
+// catch up. Each frame has its own set of queries for that reason. Passes
+// can't overlap, since only one elapsed-time query can be active at once.
+
+#define TIMER_QUERY_FRAMES 3
+#define MAX_TIMED_PASSES   4
+
+struct PassTimers
+{
+	GLuint queries[TIMER_QUERY_FRAMES][MAX_TIMED_PASSES];
+	bool issued[TIMER_QUERY_FRAMES][MAX_TIMED_PASSES];
+	int frame;
+	int active_pass;
+
+	// the latest results to come back, in milliseconds
+	double pass_times[MAX_TIMED_PASSES];
+};
+
+PassTimers create_pass_timers();
+void destroy_pass_timers(PassTimers& timers);
+
+// collects whatever results have come in and starts on the next set of queries
+void begin_timer_frame(PassTimers& timers);
+
+void begin_pass_timer(PassTimers& timers, int pass);
+void end_pass_timer(PassTimers& timers);
+
+#endif
@@ -0,0 +1,295 @@
+#include "PatternTexture.h"
+#include "GLState.h"
+
+#include "utilities/Logging.h"
+#include "utilities/StringManipulation.h"
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+#define MAX_QUEUED_TILESETS 4
+#define MAX_FAILED_TILESETS 4
+
+enum UploadStage
+{
+	UPLOAD_IDLE,
+	UPLOAD_DECODING,
+	UPLOAD_DECODED,
+	UPLOAD_TRANSFERRING,
+};
+
+struct TilesetLayer
+{
+	char filename[128]; // empty while the layer is free or being loaded
+	unsigned last_used;
+};
+
+struct TilesetCache
+{
+	GLuint texture;
+	TilesetLayer layers[TILESET_LAYERS];
+	unsigned frame;
+
+	// one tileset is loaded at a time, through the unpack buffer
+	GLuint unpack_buffer;
+	void* mapped;
+	UploadStage stage;
+	std::thread decoder;
+	std::atomic<bool> decoded;
+	bool succeeded;
+	char filename[128];
+	int layer;
+	GLsync fence;
+
+	char queued[MAX_QUEUED_TILESETS][128];
+	int queued_count;
+
+	// tilesets that couldn't be decoded, so they aren't asked for again
+	char failed[MAX_FAILED_TILESETS][128];
+	int failed_count;
+};
+
+TilesetCache* create_tileset_cache()
+{
+	TilesetCache* cache = new TilesetCache;
+
+	glGenTextures(1, &cache->texture);
+	bind_texture(GL_TEXTURE_2D_ARRAY, cache->texture);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8UI, PATTERN_SIZE, PATTERN_BANK_COUNT * PATTERNS_PER_BANK, TILESET_LAYERS, 0,
+		GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+
+	for(int i = 0; i < TILESET_LAYERS; ++i)
+	{
+		cache->layers[i].filename[0] = '\0';
+		cache->layers[i].last_used = 0;
+	}
+	cache->frame = 0;
+
+	glGenBuffers(1, &cache->unpack_buffer);
+	bind_buffer(GL_PIXEL_UNPACK_BUFFER, cache->unpack_buffer);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, sizeof(TilePatterns), nullptr, GL_STREAM_DRAW);
+	bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	cache->mapped = nullptr;
+	cache->stage = UPLOAD_IDLE;
+	cache->decoded = false;
+	cache->succeeded = false;
+	cache->filename[0] = '\0';
+	cache->layer = -1;
+	cache->fence = 0;
+	cache->queued_count = 0;
+	cache->failed_count = 0;
+
+	return cache;
+}
+
+static void unmap_unpack_buffer(TilesetCache* cache)
+{
+	bind_buffer(GL_PIXEL_UNPACK_BUFFER, cache->unpack_buffer);
+	GLboolean intact = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	cache->mapped = nullptr;
+
+	// the buffer's contents can be lost while mapped, such as on a mode change
+	if(intact == GL_FALSE)
+		cache->succeeded = false;
+}
+
+void destroy_tileset_cache(TilesetCache* cache)
+{
+	if(cache == nullptr) return;
+
+	if(cache->stage == UPLOAD_DECODING)
+	{
+		cache->decoder.join();
+		unmap_unpack_buffer(cache);
+	}
+	glDeleteSync(cache->fence);
+	forget_buffer(cache->unpack_buffer);
+	glDeleteBuffers(1, &cache->unpack_buffer);
+	forget_texture(cache->texture);
+	glDeleteTextures(1, &cache->texture);
+
+	delete cache;
+}
+
+GLuint tileset_texture(const TilesetCache* cache)
+{
+	return cache->texture;
+}
+
+static void decode_patterns(TilesetCache* cache)
+{
+	// Patterns are only ever written a byte at a time, never read back, which
+	// is what a mapped buffer that may be write-combined memory wants.
+	TilePatterns* patterns = static_cast<TilePatterns*>(cache->mapped);
+	cache->succeeded = load_tile_patterns(cache->filename, *patterns);
+	cache->decoded.store(true);
+}
+
+// returns false if the buffer couldn't be mapped, to try again next frame
+static bool begin_decoding(TilesetCache* cache, const char* filename)
+{
+	// orphan whatever the buffer held before, then map it for the decoder
+	bind_buffer(GL_PIXEL_UNPACK_BUFFER, cache->unpack_buffer);
+	GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+	cache->mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, sizeof(TilePatterns), access);
+	bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if(cache->mapped == nullptr)
+	{
+		LOG_ISSUE("OpenGL: couldn't map the buffer to decode tile patterns into");
+		return false;
+	}
+
+	copy_string(filename, cache->filename, sizeof cache->filename);
+	cache->decoded = false;
+	cache->stage = UPLOAD_DECODING;
+	cache->decoder = std::thread(decode_patterns, cache);
+	return true;
+}
+
+static int claim_layer(TilesetCache* cache)
+{
+	// prefer a free layer, then the one that's gone unused the longest
+	int best = -1;
+	for(int i = 0; i < TILESET_LAYERS; ++i)
+	{
+		const TilesetLayer& layer = cache->layers[i];
+		if(layer.filename[0] == '\0')
+			return i;
+
+		bool recently_used = layer.last_used + 1 >= cache->frame;
+		if(!recently_used && (best == -1 || layer.last_used < cache->layers[best].last_used))
+			best = i;
+	}
+	return best;
+}
+
+static void begin_transfer(TilesetCache* cache)
+{
+	int layer = claim_layer(cache);
+	if(layer == -1) return; // every layer is in use, so try again next frame
+
+	// the layer holds nothing usable until the transfer finishes
+	cache->layers[layer].filename[0] = '\0';
+	cache->layer = layer;
+
+	// With a pixel unpack buffer bound, the data "pointer" is an offset into
+	// it, and the copy into the texture happens without the CPU waiting on it.
+	bind_texture(GL_TEXTURE_2D_ARRAY, cache->texture);
+	bind_buffer(GL_PIXEL_UNPACK_BUFFER, cache->unpack_buffer);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, PATTERN_SIZE, PATTERN_BANK_COUNT * PATTERNS_PER_BANK, 1,
+		GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+	bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	count_upload(sizeof(TilePatterns));
+
+	cache->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	cache->stage = UPLOAD_TRANSFERRING;
+}
+
+void update_tileset_cache(TilesetCache* cache)
+{
+	cache->frame += 1;
+
+	if(cache->stage == UPLOAD_DECODING && cache->decoded.load())
+	{
+		cache->decoder.join();
+		unmap_unpack_buffer(cache);
+
+		if(cache->succeeded)
+		{
+			cache->stage = UPLOAD_DECODED;
+		}
+		else
+		{
+			LOG_ISSUE("couldn't decode tile patterns from %s", cache->filename);
+			cache->stage = UPLOAD_IDLE;
+
+			// the oldest failure is forgotten to make room
+			int slot = cache->failed_count % MAX_FAILED_TILESETS;
+			copy_string(cache->filename, cache->failed[slot], sizeof cache->failed[0]);
+			cache->failed_count += 1;
+		}
+	}
+
+	if(cache->stage == UPLOAD_DECODED)
+	{
+		begin_transfer(cache);
+	}
+	else if(cache->stage == UPLOAD_TRANSFERRING)
+	{
+		GLenum result = glClientWaitSync(cache->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if(result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+		{
+			glDeleteSync(cache->fence);
+			cache->fence = 0;
+
+			TilesetLayer& layer = cache->layers[cache->layer];
+			copy_string(cache->filename, layer.filename, sizeof layer.filename);
+			layer.last_used = cache->frame;
+			cache->stage = UPLOAD_IDLE;
+		}
+	}
+
+	if(cache->stage == UPLOAD_IDLE && cache->queued_count > 0 && begin_decoding(cache, cache->queued[0]))
+	{
+		cache->queued_count -= 1;
+		memmove(cache->queued[0], cache->queued[1], sizeof cache->queued[0] * cache->queued_count);
+	}
+}
+
+static void queue_tileset(TilesetCache* cache, const char* filename)
+{
+	if(cache->stage != UPLOAD_IDLE && strcmp(cache->filename, filename) == 0)
+		return;
+
+	for(int i = 0; i < cache->queued_count; ++i)
+	{
+		if(strcmp(cache->queued[i], filename) == 0)
+			return;
+	}
+
+	for(int i = 0; i < cache->failed_count && i < MAX_FAILED_TILESETS; ++i)
+	{
+		if(strcmp(cache->failed[i], filename) == 0)
+			return;
+	}
+
+	if(cache->queued_count == MAX_QUEUED_TILESETS)
+	{
+		LOG_ISSUE("too many tilesets waiting to load, so %s was skipped", filename);
+		return;
+	}
+
+	copy_string(filename, cache->queued[cache->queued_count], sizeof cache->queued[0]);
+	cache->queued_count += 1;
+}
+
+int use_tileset(TilesetCache* cache, const char* filename)
+{
+	if(filename == nullptr || filename[0] == '\0')
+		return -1;
+
+	for(int i = 0; i < TILESET_LAYERS; ++i)
+	{
+		TilesetLayer& layer = cache->layers[i];
+		if(strcmp(layer.filename, filename) == 0)
+		{
+			layer.last_used = cache->frame;
+			return i;
+		}
+	}
+
+	queue_tileset(cache, filename);
+	return -1;
+}
+
+void use_tileset_layer(TilesetCache* cache, int layer)
+{
+	cache->layers[layer].last_used = cache->frame;
+}
@@ -0,0 +1,38 @@
+#ifndef PATTERN_TEXTURE_H
+#define PATTERN_TEXTURE_H
+
+#include "gl_core_3_3.h"
+#include "TilePatterns.h"
+
+// Tile patterns are kept on the GPU exactly as they're stored in VRAM, as an
+// integer texture with one row per tile and one texel per byte. Bank 1 follows
+// on from bank 0, so a tile's row is its number plus 384 for the second bank.
+// Shaders decode the colour numbers and look them up in the palettes.
+//
+// Several tilesets are kept resident at once as the layers of one texture
+// array, so switching between them is only a change of layer index. When
+// every layer is taken, the tileset used least recently is replaced.
+//
+// Loading a tileset happens in stages so that none of them holds up a frame.
+// The image is decoded on its own thread straight into a mapped pixel unpack
+// buffer, the texture upload is issued from that buffer once decoding is done,
+// and the layer is only handed out once a fence says the upload completed.
+
+#define TILESET_LAYERS 8
+
+struct TilesetCache;
+
+TilesetCache* create_tileset_cache();
+void destroy_tileset_cache(TilesetCache* cache);
+GLuint tileset_texture(const TilesetCache* cache);
+
+// call once a frame, before any use_tileset
+void update_tileset_cache(TilesetCache* cache);
+
+// Returns the layer holding a tileset's patterns, or -1 if it isn't resident
+// yet, in which case it's queued to be loaded. A layer used this frame or the
+// last is never replaced.
+int use_tileset(TilesetCache* cache, const char* filename);
+void use_tileset_layer(TilesetCache* cache, int layer);
+
+#endif
@@ -0,0 +1,123 @@
+#include "RenderCommands.h"
+#include "GLState.h"
+
+#include "utilities/ArrayMacros.h"
+
+#include <cassert>
+#include <cstdint>
+
+void begin_command_pass(CommandBuffer& buffer, GLuint framebuffer, GLsizei width, GLsizei height, const GLfloat clear_color[4])
+{
+	assert(buffer.pass_count < MAX_COMMAND_PASSES);
+
+	CommandPass& pass = buffer.passes[buffer.pass_count];
+	buffer.pass_count += 1;
+
+	pass.framebuffer = framebuffer;
+	pass.width = width;
+	pass.height = height;
+	pass.clear = clear_color != nullptr;
+	for(int i = 0; i < 4 && pass.clear; ++i)
+		pass.clear_color[i] = clear_color[i];
+}
+
+DrawCommand& push_draw(CommandBuffer& buffer, int layer)
+{
+	assert(buffer.pass_count > 0);
+	assert(buffer.count < MAX_DRAW_COMMANDS);
+
+	DrawCommand& command = buffer.commands[buffer.count];
+	buffer.count += 1;
+
+	CLEAR(&command, 1);
+	command.pass = buffer.pass_count - 1;
+	command.layer = layer;
+	command.timer = -1;
+	return command;
+}
+
+static uint64_t sort_key(const DrawCommand& command)
+{
+	// Pass and layer first, then in order of how costly each change is. Names
+	// only need to group equal ones together, so the low bits are plenty.
+	return static_cast<uint64_t>(command.pass & 0xFF) << 56 |
+		static_cast<uint64_t>(command.layer & 0xFF) << 48 |
+		static_cast<uint64_t>(command.program & 0xFFFF) << 32 |
+		static_cast<uint64_t>(command.textures[0] & 0xFFFF) << 16 |
+		static_cast<uint64_t>(command.vertex_array & 0xFFFF);
+}
+
+static void draw_command(const DrawCommand& command, const UniformRing& uniforms)
+{
+	use_program(command.program);
+	for(int unit = 0; unit < COMMAND_TEXTURE_UNITS; ++unit)
+	{
+		if(command.textures[unit] != 0)
+			bind_texture_unit(unit, command.texture_targets[unit], command.textures[unit]);
+	}
+	if(command.uniform_size > 0)
+		bind_uniforms(uniforms, 0, command.uniform_offset, command.uniform_size);
+	bind_vertex_array(command.vertex_array);
+
+	switch(command.type)
+	{
+		case DRAW_INDEXED_TRIANGLES:
+			glDrawElements(GL_TRIANGLES, command.count, GL_UNSIGNED_SHORT, nullptr);
+			break;
+		case DRAW_INSTANCED_STRIP:
+			glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, command.count, command.instances);
+			break;
+	}
+	count_draw();
+}
+
+void submit_commands(CommandBuffer& buffer, const UniformRing& uniforms, PassTimers& timers)
+{
+	// There are only ever a few dozen commands, so an insertion sort does,
+	// and it keeps draws with equal keys in the order they were recorded.
+	int order[MAX_DRAW_COMMANDS];
+	uint64_t keys[MAX_DRAW_COMMANDS];
+	for(int i = 0; i < buffer.count; ++i)
+	{
+		uint64_t key = sort_key(buffer.commands[i]);
+		int j = i;
+		for(; j > 0 && keys[j - 1] > key; --j)
+		{
+			keys[j] = keys[j - 1];
+			order[j] = order[j - 1];
+		}
+		keys[j] = key;
+		order[j] = i;
+	}
+
+	// the sorted draws come in pass order, so each pass takes the next run
+	int next = 0;
+	int active_timer = -1;
+	for(int i = 0; i < buffer.pass_count; ++i)
+	{
+		const CommandPass& pass = buffer.passes[i];
+		glBindFramebuffer(GL_FRAMEBUFFER, pass.framebuffer);
+		glViewport(0, 0, pass.width, pass.height);
+		if(pass.clear)
+			glClearBufferfv(GL_COLOR, 0, pass.clear_color);
+
+		for(; next < buffer.count && buffer.commands[order[next]].pass == i; ++next)
+		{
+			const DrawCommand& command = buffer.commands[order[next]];
+			if(command.timer != active_timer)
+			{
+				if(active_timer != -1)
+					end_pass_timer(timers);
+				if(command.timer != -1)
+					begin_pass_timer(timers, command.timer);
+				active_timer = command.timer;
+			}
+			draw_command(command, uniforms);
+		}
+	}
+	if(active_timer != -1)
+		end_pass_timer(timers);
+
+	buffer.count = 0;
+	buffer.pass_count = 0;
+}
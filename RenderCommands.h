@@ -0,0 +1,97 @@
+#ifndef RENDER_COMMANDS_H
+#define RENDER_COMMANDS_H
+
+#include "gl_core_3_3.h"
+#include "Mesh.h"
+#include "UniformRing.h"
+#include "PassTimers.h"
+
+// Passes record their draws into a command buffer instead of making GL calls
+// directly. On submission the draws are sorted by the state they need, so
+// draws sharing a program and textures end up next to each other, and the
+// state changes between them go through GLState, which drops any bind that
+// would change nothing.
+//
+// Draws are only ever reordered within a layer. Layers are drawn in order,
+// so anything that has to appear over something else goes in a later layer.
+//
+// A whole frame is recorded before anything is submitted. It's split into
+// passes, each drawing to its own framebuffer, and draws never move from one
+// pass to another. Each draw can name a pass timer to be counted under, and
+// the timers are started and stopped around the runs of draws that share one,
+// so a layer's draws should all share a timer.
+
+#define MAX_DRAW_COMMANDS     64
+#define MAX_COMMAND_PASSES    4
+#define COMMAND_TEXTURE_UNITS 2
+
+enum DrawType
+{
+	DRAW_INDEXED_TRIANGLES,
+	DRAW_INSTANCED_STRIP,
+};
+
+struct DrawCommand
+{
+	int pass;
+	int layer;
+	int timer; // which PassTimers pass it counts towards, or -1 for none
+	GLuint program;
+	GLenum texture_targets[COMMAND_TEXTURE_UNITS];
+	GLuint textures[COMMAND_TEXTURE_UNITS]; // 0 leaves a unit as it is
+	GLuint vertex_array;
+	GLintptr uniform_offset; // an ObjectBlock pushed to the uniform ring
+	GLsizeiptr uniform_size;
+
+	DrawType type;
+	GLsizei count; // indices, or vertices per instance
+	GLsizei instances;
+};
+
+struct CommandPass
+{
+	GLuint framebuffer;
+	GLsizei width, height;
+	bool clear;
+	GLfloat clear_color[4];
+};
+
+struct CommandBuffer
+{
+	DrawCommand commands[MAX_DRAW_COMMANDS];
+	int count;
+	CommandPass passes[MAX_COMMAND_PASSES];
+	int pass_count;
+};
+
+// Draws pushed after this go to the given framebuffer, until the next pass
+// begins. The pass is bound and cleared even if nothing is drawn in it.
+void begin_command_pass(CommandBuffer& buffer, GLuint framebuffer, GLsizei width, GLsizei height, const GLfloat clear_color[4]);
+
+// returns a cleared command in the current pass to fill in
+DrawCommand& push_draw(CommandBuffer& buffer, int layer);
+
+// draws everything recorded, pass by pass, and empties the buffer
+void submit_commands(CommandBuffer& buffer, const UniformRing& uniforms, PassTimers& timers);
+
+static inline void set_draw_texture(DrawCommand& command, int unit, GLenum target, GLuint texture)
+{
+	command.texture_targets[unit] = target;
+	command.textures[unit] = texture;
+}
+
+static inline void set_draw_uniforms(DrawCommand& command, GLintptr offset, GLsizeiptr size)
+{
+	command.uniform_offset = offset;
+	command.uniform_size = size;
+}
+
+static inline void set_mesh_draw(DrawCommand& command, const Mesh& mesh)
+{
+	command.vertex_array = mesh.vertex_array;
+	command.type = DRAW_INDEXED_TRIANGLES;
+	command.count = mesh.num_indices;
+	command.instances = 1;
+}
+
+#endif
@@ -1,9 +1,18 @@
 #include "RenderSystem.h"
 #include "Shader.h"
-#include "Texture.h"
 #include "Mesh.h"
 #include "Tilemap.h"
+#include "TilemapTexture.h"
+#include "TilePatterns.h"
+#include "PatternTexture.h"
+#include "PaletteRam.h"
+#include "UniformRing.h"
+#include "RenderCommands.h"
+#include "GLState.h"
+#include "PassTimers.h"
+#include "FrameCapture.h"
 #include "SpriteBatch.h"
+#include "OamScan.h"
 #include "Game.h"
 
 #include "utilities/ArrayMacros.h"
@@ -13,6 +22,13 @@
 
 #include <cassert>
 
+// room for plenty of passes, even with 256-byte aligned blocks
+#define UNIFORM_RING_FRAME_SIZE 4096
+
+// draws in the same layer may be reordered to share state, across layers not
+#define LAYER_BACKGROUND 0
+#define LAYER_SPRITES    1
+
 namespace RenderSystem {
 
 namespace
@@ -21,19 +37,43 @@ namespace
 	GLuint framebuffers[1];
 
 	GLuint default_shader;
+	GLuint background_shader;
+	GLuint sprite_shader;
 	GLuint samplers[1];
 	
+	// values that change from one pass to the next, laid out as std140
 	struct ObjectBlock
 	{
 		GLfloat model_view_projection[16];
+		GLint scroll[2];
+		GLint palette_base;
+		GLint tileset;
+		GLint background_tileset;
+		GLint padding[3]; // std140 rounds a block up to a multiple of a vec4
 	};
-	GLuint object_uniform_buffer;
+	static_assert(sizeof(ObjectBlock) % 16 == 0, "ObjectBlock must be a whole number of vec4s");
+	UniformRing uniform_ring;
+	CommandBuffer commands;
+	PassTimers pass_timers;
+	GLStateCounters frame_counters;
+	FrameCapture* frame_capture = nullptr;
+
+	// PaletteRam's colours as they are, packed two to a uint in the shaders
+	struct PaletteBlock
+	{
+		word_t colors[PALETTE_RAM_COLORS];
+	};
+	GLuint palette_uniform_buffer;
 
 	GLfloat projection_matrix[16];
 
-	GLuint tile_atlas;
-	Mesh tilemap_mesh;
+	// the layer of each pass's tileset which was last ready to draw with
+	TilesetCache* tilesets;
+	int background_tileset = -1;
+	int sprite_tileset = -1;
+	GLuint tilemap_texture;
 	Mesh sprite_batch_mesh;
+	ScanlineSprites scanlines;
 	
 	Mesh framebuffer_mesh;
 	GLfloat framebuffer_mesh_matrix[16] =
@@ -94,11 +134,13 @@ static bool check_error(const char* description)
 
 bool Initialise(int target_width, int target_height, int scale)
 {
+	reset_gl_state();
+
 	// create target textures
 	glGenTextures(ARRAY_COUNT(target_textures), target_textures);
 
 	assert(target_textures[0] != 0);
-	glBindTexture(GL_TEXTURE_2D, target_textures[0]);
+	bind_texture(GL_TEXTURE_2D, target_textures[0]);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, target_width, target_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 	if(check_error("framebuffer target texture creation failed"))
 		return false;
@@ -128,6 +170,12 @@ bool Initialise(int target_width, int target_height, int scale)
 	default_shader = load_shader_program("default.vert", "default.frag");
 	if(default_shader == 0) return false;
 
+	background_shader = load_shader_program("default.vert", "background.frag");
+	if(background_shader == 0) return false;
+
+	sprite_shader = load_shader_program("sprite.vert", "sprite.frag");
+	if(sprite_shader == 0) return false;
+
 	// create samplers
 	{
 		glGenSamplers(ARRAY_COUNT(samplers), samplers);
@@ -144,38 +192,65 @@ bool Initialise(int target_width, int target_height, int scale)
 			return false;
 
 		// set default samplers to texture units
-		glActiveTexture(GL_TEXTURE0);
 		glBindSampler(0, pixel_perfect);
+		glBindSampler(1, pixel_perfect);
 	}
 
 	// create uniform buffers
 	{
+		uniform_ring = create_uniform_ring(UNIFORM_RING_FRAME_SIZE);
+
+		// filled in from the game's palette RAM, which starts out all changed
 		GLuint buffer;
 		glGenBuffers(1, &buffer);
-		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
-		glBufferData(GL_UNIFORM_BUFFER, sizeof(ObjectBlock), nullptr, GL_STREAM_DRAW);
-		object_uniform_buffer = buffer;
+		bind_buffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(PaletteBlock), nullptr, GL_DYNAMIC_DRAW);
+		palette_uniform_buffer = buffer;
 	}
 
 	// bind uniform buffers to shaders
 	{
 		GLuint block_index = glGetUniformBlockIndex(default_shader, "ObjectBlock");
 		glUniformBlockBinding(default_shader, block_index, 0);
-		glBindBuffer(GL_UNIFORM_BUFFER, object_uniform_buffer);
-		glBindBufferBase(GL_UNIFORM_BUFFER, 0, object_uniform_buffer);
+
+		block_index = glGetUniformBlockIndex(background_shader, "ObjectBlock");
+		glUniformBlockBinding(background_shader, block_index, 0);
+
+		block_index = glGetUniformBlockIndex(sprite_shader, "ObjectBlock");
+		glUniformBlockBinding(sprite_shader, block_index, 0);
+
+		block_index = glGetUniformBlockIndex(background_shader, "PaletteBlock");
+		glUniformBlockBinding(background_shader, block_index, 1);
+
+		block_index = glGetUniformBlockIndex(sprite_shader, "PaletteBlock");
+		glUniformBlockBinding(sprite_shader, block_index, 1);
+
+		bind_uniform_buffer_base(1, palette_uniform_buffer);
 	}
 
 	// set uniform locations for shaders
 	{
-		glUseProgram(default_shader);
+		use_program(default_shader);
 		GLint location = glGetUniformLocation(default_shader, "texture");
 		glUniform1i(location, 0);
+
+		use_program(background_shader);
+		location = glGetUniformLocation(background_shader, "patterns");
+		glUniform1i(location, 0);
+		location = glGetUniformLocation(background_shader, "tilemap");
+		glUniform1i(location, 1);
+
+		use_program(sprite_shader);
+		location = glGetUniformLocation(sprite_shader, "patterns");
+		glUniform1i(location, 0);
+		location = glGetUniformLocation(sprite_shader, "tilemap");
+		glUniform1i(location, 1);
 	}
 
 	// create framebuffer mesh
 	{
 		glGenVertexArrays(1, &framebuffer_mesh.vertex_array);
-		glBindVertexArray(framebuffer_mesh.vertex_array);
+		bind_vertex_array(framebuffer_mesh.vertex_array);
 
 		glGenBuffers(ARRAY_COUNT(framebuffer_mesh.buffers), framebuffer_mesh.buffers);
 
@@ -186,7 +261,7 @@ bool Initialise(int target_width, int target_height, int scale)
 			1, -1, 1, 1,
 			-1, -1, 0, 1,
 		};
-		glBindBuffer(GL_ARRAY_BUFFER, framebuffer_mesh.buffers[0]);
+		bind_buffer(GL_ARRAY_BUFFER, framebuffer_mesh.buffers[0]);
 		glBufferData(GL_ARRAY_BUFFER, sizeof vertices, vertices, GL_STATIC_DRAW);
 
 		GLsizei stride = sizeof(GLfloat) * 4;
@@ -202,7 +277,7 @@ bool Initialise(int target_width, int target_height, int scale)
 
 		framebuffer_mesh.num_indices = ARRAY_COUNT(indices);
 
-		glBindVertexArray(0);
+		bind_vertex_array(0);
 	}
 
 	// set projection matrix
@@ -217,14 +292,16 @@ bool Initialise(int target_width, int target_height, int scale)
 		copy_matrix(orthographic, projection_matrix);
 	}
 
-	tile_atlas = make_texture(nullptr, 256, 192);
-	if(check_error("failed to make texture for storing tile atlas"))
+	tilesets = create_tileset_cache();
+	if(check_error("failed to make texture array for storing tilesets"))
 		return false;
 
 	sprite_batch_mesh = create_sprite_batch_mesh();
 	if(check_error("sprite batch mesh creation failed"))
 		return false;
 
+	pass_timers = create_pass_timers();
+
 	frame_width = target_width;
 	frame_height = target_height;
 	magnification = scale;
@@ -234,82 +311,232 @@ bool Initialise(int target_width, int target_height, int scale)
 
 void Terminate()
 {
+	Stop_Capture();
+	destroy_pass_timers(pass_timers);
 	destroy_mesh(sprite_batch_mesh);
-	destroy_mesh(tilemap_mesh);
-	glDeleteTextures(1, &tile_atlas);
+	forget_texture(tilemap_texture);
+	glDeleteTextures(1, &tilemap_texture);
+	destroy_tileset_cache(tilesets);
 	destroy_mesh(framebuffer_mesh);
 
-	glDeleteBuffers(1, &object_uniform_buffer);
+	glDeleteBuffers(1, &palette_uniform_buffer);
+	destroy_uniform_ring(uniform_ring);
 
 	glDeleteSamplers(ARRAY_COUNT(samplers), samplers);
+	glDeleteProgram(sprite_shader);
+	glDeleteProgram(background_shader);
 	glDeleteProgram(default_shader);
 
 	glDeleteTextures(ARRAY_COUNT(target_textures), target_textures);
 	glDeleteFramebuffers(ARRAY_COUNT(framebuffers), framebuffers);
+
+	reset_gl_state();
 }
 
-void Load_Map(const Tilemap& map, const char* pattern_filename)
+void Load_Map(Tilemap& map)
 {
-	tilemap_mesh = create_tilemap_mesh(map);
+	// the new texture is likely to be given the same name as the old one
+	forget_texture(tilemap_texture);
+	glDeleteTextures(1, &tilemap_texture);
+	tilemap_texture = create_tilemap_texture(map);
+	clear_dirty_tiles(map);
+}
 
-	// load tile atlas with pattern image
+static int Use_Tileset(const char* filename, int& layer)
+{
+	// A tileset that isn't resident yet takes a few frames to load, so until
+	// then keep drawing with whichever one was used before rather than stall.
+	int found = use_tileset(tilesets, filename);
+	if(found != -1)
+		layer = found;
+	else if(layer != -1)
+		use_tileset_layer(tilesets, layer);
+	return layer;
+}
+
+static void Update_Map(Tilemap& map)
+{
+	// only send the tiles that changed since the last frame
+	for(int i = 0; i < map.dirty_rect_count; ++i)
 	{
-		int width, height;
-		void* data = load_image(pattern_filename, &width, &height);
-		buffer_data_to_texture(data, width, height, tile_atlas);
-		unload_image(data);
+		buffer_tilemap_region(map, map.dirty_rects[i], tilemap_texture);
 	}
+	clear_dirty_tiles(map);
 }
 
-static void Set_MVP_Matrix(GLfloat matrix[16])
+static void Update_Palettes(PaletteRam& palettes)
 {
-	ObjectBlock block;
-	copy_matrix(matrix, block.model_view_projection);
+	// send each run of changed colours as one range
+	bind_buffer(GL_UNIFORM_BUFFER, palette_uniform_buffer);
+
+	const word_t* colors = &palettes.colors[0][0];
+	uint64_t dirty = palettes.dirty;
+	for(int first = 0; first < PALETTE_RAM_COLORS; )
+	{
+		if(!(dirty & (1ull << first)))
+		{
+			++first;
+			continue;
+		}
 
-	glBindBuffer(GL_UNIFORM_BUFFER, object_uniform_buffer);
-	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof block, &block);
+		int end = first + 1;
+		while(end < PALETTE_RAM_COLORS && (dirty & (1ull << end)))
+			++end;
+
+		glBufferSubData(GL_UNIFORM_BUFFER, sizeof(word_t) * first, sizeof(word_t) * (end - first), colors + first);
+		count_upload(sizeof(word_t) * (end - first));
+		first = end;
+	}
+	clear_dirty_colors(palettes);
 }
 
-static void Draw_Mesh(const Mesh& mesh)
+static void Set_Object_Block(ObjectBlock& block, const GLfloat matrix[16], int scroll_x, int scroll_y, int palette_base, int tileset, int background_tileset)
 {
-	glBindVertexArray(mesh.vertex_array);
-	glDrawElements(GL_TRIANGLES, mesh.num_indices, GL_UNSIGNED_SHORT, nullptr);
+	copy_matrix(matrix, block.model_view_projection);
+	block.scroll[0] = scroll_x;
+	block.scroll[1] = scroll_y;
+	block.palette_base = palette_base;
+	block.tileset = tileset;
+	block.background_tileset = background_tileset;
+	CLEAR_ARRAY(block.padding);
 }
 
 void Update(const Game::GameState& game)
 {
+	reset_gl_state_counters();
+	begin_timer_frame(pass_timers);
+
 	// check game state for anything new
 	if(game.load_map)
 	{
-		Load_Map(*game.tilemap, game.atlas_name);
+		Load_Map(*game.tilemap);
+	}
+	else if(game.tilemap->dirty_rect_count > 0)
+	{
+		Update_Map(*game.tilemap);
 	}
 
-	// draw to framebuffer textures
-	glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[0]);
-	glViewport(0, 0, frame_width, frame_height);
-	GLfloat clear_color[4] = { 1.0f, 0.0f, 1.0f, 1.0f };
-	glClearBufferfv(GL_COLOR, 0, clear_color);
+	if(game.palettes->dirty != 0)
+	{
+		Update_Palettes(*game.palettes);
+	}
 
-	glUseProgram(default_shader);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, tile_atlas);
-	Set_MVP_Matrix(projection_matrix);
+	// Switching to a tileset that's already resident is only a change of
+	// layer, and the background and sprites can each use a different one.
+	update_tileset_cache(tilesets);
+	Use_Tileset(game.background_tileset, background_tileset);
+	Use_Tileset(game.sprite_tileset, sprite_tileset);
 
-	Draw_Mesh(tilemap_mesh);
+	// Every pass's uniforms are written up front in one go, into a part of the
+	// ring that no earlier frame still in flight can be reading from.
+	GLintptr background_uniforms, sprite_uniforms, blit_uniforms;
+	{
+		ObjectBlock block;
+		begin_uniform_writes(uniform_ring);
+
+		Set_Object_Block(block, framebuffer_mesh_matrix, game.scroll_x, game.scroll_y, 0, background_tileset, background_tileset);
+		background_uniforms = push_uniforms(uniform_ring, &block, sizeof block);
+
+		// sprites look up the background behind them to know if it covers them
+		Set_Object_Block(block, projection_matrix, game.scroll_x, game.scroll_y, OBJECT_PALETTES, sprite_tileset, background_tileset);
+		sprite_uniforms = push_uniforms(uniform_ring, &block, sizeof block);
+
+		Set_Object_Block(block, framebuffer_mesh_matrix, 0, 0, 0, 0, 0);
+		blit_uniforms = push_uniforms(uniform_ring, &block, sizeof block);
+
+		end_uniform_writes(uniform_ring);
+	}
+
+	// The whole frame is recorded, then submitted in one go, so the sort sees
+	// every pass's draws and state carries over from one pass to the next.
+	GLfloat clear_color[4] = { 1.0f, 0.0f, 1.0f, 1.0f };
+	begin_command_pass(commands, framebuffers[0], frame_width, frame_height, clear_color);
 
-	buffer_sprites(game.sprites, sprite_batch_mesh.buffers[0]);
-	Draw_Mesh(sprite_batch_mesh);
+	// The background is resolved per pixel from the tilemap texture, so one
+	// quad covering the whole target is enough to draw all of it.
+	if(tilemap_texture != 0 && background_tileset != -1)
+	{
+		DrawCommand& draw = push_draw(commands, LAYER_BACKGROUND);
+		draw.timer = PASS_BACKGROUND;
+		draw.program = background_shader;
+		set_draw_texture(draw, 0, GL_TEXTURE_2D_ARRAY, tileset_texture(tilesets));
+		set_draw_texture(draw, 1, GL_TEXTURE_2D_ARRAY, tilemap_texture);
+		set_draw_uniforms(draw, background_uniforms, sizeof(ObjectBlock));
+		set_mesh_draw(draw, framebuffer_mesh);
+	}
+
+	if(sprite_tileset != -1)
+	{
+		scan_oam(game.sprites, frame_height, game.sprite_scan_start, scanlines);
+		buffer_sprites(game.sprites, scanlines, sprite_batch_mesh.buffers[0]);
+
+		DrawCommand& draw = push_draw(commands, LAYER_SPRITES);
+		draw.timer = PASS_SPRITES;
+		draw.program = sprite_shader;
+		set_draw_texture(draw, 0, GL_TEXTURE_2D_ARRAY, tileset_texture(tilesets));
+		set_draw_texture(draw, 1, GL_TEXTURE_2D_ARRAY, tilemap_texture);
+		set_draw_uniforms(draw, sprite_uniforms, sizeof(ObjectBlock));
+		set_sprite_batch_draw(draw, sprite_batch_mesh);
+	}
 
 	// draw framebuffer texture to rendering context
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glViewport(0, 0, magnification * frame_width, magnification * frame_height);
-	glClear(GL_COLOR_BUFFER_BIT);
-	
-	glUseProgram(default_shader);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, target_textures[0]);
-	Set_MVP_Matrix(framebuffer_mesh_matrix);
-	Draw_Mesh(framebuffer_mesh);
+	GLfloat blit_clear_color[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	begin_command_pass(commands, 0, magnification * frame_width, magnification * frame_height, blit_clear_color);
+
+	{
+		DrawCommand& draw = push_draw(commands, 0);
+		draw.timer = PASS_BLIT;
+		draw.program = default_shader;
+		set_draw_texture(draw, 0, GL_TEXTURE_2D, target_textures[0]);
+		set_draw_uniforms(draw, blit_uniforms, sizeof(ObjectBlock));
+		set_mesh_draw(draw, framebuffer_mesh);
+	}
+
+	submit_commands(commands, uniform_ring, pass_timers);
+
+	// read back the finished frame as it was before being scaled up
+	if(frame_capture != nullptr)
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[0]);
+		capture_frame(frame_capture);
+	}
+
+	fence_uniform_frame(uniform_ring);
+
+	frame_counters = gl_state_counters();
+}
+
+FrameStats Get_Frame_Stats()
+{
+	FrameStats stats = {};
+	for(int i = 0; i < PASS_COUNT; ++i)
+	{
+		stats.pass_times[i] = pass_timers.pass_times[i];
+	}
+	stats.draws = frame_counters.draws;
+	stats.binds = frame_counters.program_binds + frame_counters.texture_binds +
+		frame_counters.vertex_array_binds + frame_counters.buffer_binds;
+	stats.redundant_binds = frame_counters.redundant_binds;
+	stats.upload_bytes = frame_counters.upload_bytes;
+	return stats;
+}
+
+bool Start_Capture(const char* filename)
+{
+	Stop_Capture();
+	frame_capture = begin_frame_capture(filename, frame_width, frame_height);
+	return frame_capture != nullptr;
+}
+
+void Stop_Capture()
+{
+	end_frame_capture(frame_capture);
+	frame_capture = nullptr;
+}
+
+bool Is_Capturing()
+{
+	return frame_capture != nullptr;
 }
 
 } // namespace GLRenderer
\ No newline at end of file
@@ -3,11 +3,38 @@
 
 #include "Game.h"
 
+#include <cstddef>
+
 namespace RenderSystem
 {
+	enum RenderPass
+	{
+		PASS_BACKGROUND,
+		PASS_SPRITES,
+		PASS_BLIT,
+		PASS_COUNT,
+	};
+
+	// GPU times lag a couple of frames behind the rest, which are counted over
+	// the last call to Update. Passes that weren't drawn take no time.
+	struct FrameStats
+	{
+		double pass_times[PASS_COUNT]; // milliseconds
+		int draws;
+		int binds;
+		int redundant_binds;
+		size_t upload_bytes;
+	};
+
 	bool Initialise(int target_width, int target_height, int scale);
 	void Terminate();
 	void Update(const Game::GameState& game);
+	FrameStats Get_Frame_Stats();
+
+	// records every frame from here on to a file, at the target resolution
+	bool Start_Capture(const char* filename);
+	void Stop_Capture();
+	bool Is_Capturing();
 }
 
 #endif
\ No newline at end of file
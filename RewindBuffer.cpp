@@ -0,0 +1,183 @@
+#include "RewindBuffer.h"
+
+#include "utilities/ArrayMacros.h"
+#include "utilities/Logging.h"
+#include "utilities/RunLength.h"
+
+#include <cstdint>
+#include <cstring>
+
+// Differences are stored back to back in a ring of bytes, wrapping around the
+// end, each with its size both before and after it, so that the ring can be
+// walked from either end: forwards from the oldest to drop it, and backwards
+// from the newest to step back.
+
+struct RewindBuffer
+{
+	size_t state_size;
+	unsigned char* newest; // the last state pushed, whole
+	bool has_newest;
+
+	unsigned char* difference; // scratch for XORing and encoding
+	unsigned char* packed;
+
+	unsigned char* ring;
+	size_t capacity;
+	size_t start; // the oldest difference
+	size_t used;
+	int count;
+};
+
+RewindBuffer* create_rewind_buffer(size_t state_size, size_t capacity)
+{
+	RewindBuffer* buffer = new RewindBuffer;
+	buffer->state_size = state_size;
+	buffer->newest = new unsigned char[state_size];
+	buffer->has_newest = false;
+	buffer->difference = new unsigned char[state_size];
+	buffer->packed = new unsigned char[run_length_bound(state_size)];
+	buffer->ring = new unsigned char[capacity];
+	buffer->capacity = capacity;
+	buffer->start = 0;
+	buffer->used = 0;
+	buffer->count = 0;
+	return buffer;
+}
+
+void destroy_rewind_buffer(RewindBuffer* buffer)
+{
+	if(buffer == nullptr) return;
+
+	delete[] buffer->newest;
+	delete[] buffer->difference;
+	delete[] buffer->packed;
+	delete[] buffer->ring;
+	delete buffer;
+}
+
+void clear_rewind_buffer(RewindBuffer* buffer)
+{
+	buffer->has_newest = false;
+	buffer->start = 0;
+	buffer->used = 0;
+	buffer->count = 0;
+}
+
+int rewind_state_count(const RewindBuffer* buffer)
+{
+	return buffer->count;
+}
+
+static void write_ring(RewindBuffer* buffer, size_t offset, const void* data, size_t size)
+{
+	offset %= buffer->capacity;
+	size_t first = buffer->capacity - offset;
+	if(first > size) first = size;
+
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	COPY(bytes, buffer->ring + offset, first);
+	COPY(bytes + first, buffer->ring, size - first);
+}
+
+static void read_ring(const RewindBuffer* buffer, size_t offset, void* data, size_t size)
+{
+	offset %= buffer->capacity;
+	size_t first = buffer->capacity - offset;
+	if(first > size) first = size;
+
+	unsigned char* bytes = static_cast<unsigned char*>(data);
+	COPY(buffer->ring + offset, bytes, first);
+	COPY(buffer->ring, bytes + first, size - first);
+}
+
+static void drop_oldest(RewindBuffer* buffer)
+{
+	uint32_t size;
+	read_ring(buffer, buffer->start, &size, sizeof size);
+	size_t entry_size = size + 2 * sizeof size;
+
+	buffer->start = (buffer->start + entry_size) % buffer->capacity;
+	buffer->used -= entry_size;
+	buffer->count -= 1;
+}
+
+static void xor_states(const unsigned char* a, const unsigned char* b, unsigned char* result, size_t size)
+{
+	// a word at a time where possible, since this runs over the whole state
+	size_t i = 0;
+	for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+	{
+		uint64_t x, y;
+		memcpy(&x, a + i, sizeof x);
+		memcpy(&y, b + i, sizeof y);
+		x ^= y;
+		memcpy(result + i, &x, sizeof x);
+	}
+	for(; i < size; ++i)
+	{
+		result[i] = a[i] ^ b[i];
+	}
+}
+
+void push_rewind_state(RewindBuffer* buffer, const void* state)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(state);
+	if(!buffer->has_newest)
+	{
+		COPY(bytes, buffer->newest, buffer->state_size);
+		buffer->has_newest = true;
+		return;
+	}
+
+	xor_states(buffer->newest, bytes, buffer->difference, buffer->state_size);
+	COPY(bytes, buffer->newest, buffer->state_size);
+
+	uint32_t size = static_cast<uint32_t>(run_length_encode(buffer->difference, buffer->state_size, buffer->packed));
+	size_t entry_size = size + 2 * sizeof size;
+	if(entry_size > buffer->capacity)
+	{
+		// can't keep this one at all, and everything older leads up to it
+		buffer->start = 0;
+		buffer->used = 0;
+		buffer->count = 0;
+		return;
+	}
+
+	while(buffer->used + entry_size > buffer->capacity)
+		drop_oldest(buffer);
+
+	size_t end = buffer->start + buffer->used;
+	write_ring(buffer, end, &size, sizeof size);
+	write_ring(buffer, end + sizeof size, buffer->packed, size);
+	write_ring(buffer, end + sizeof size + size, &size, sizeof size);
+	buffer->used += entry_size;
+	buffer->count += 1;
+}
+
+bool pop_rewind_state(RewindBuffer* buffer, void* state)
+{
+	if(buffer->count == 0)
+		return false;
+
+	size_t end = buffer->start + buffer->used;
+	uint32_t size;
+	read_ring(buffer, end - sizeof size, &size, sizeof size);
+	size_t entry_size = size + 2 * sizeof size;
+	read_ring(buffer, end - entry_size + sizeof size, buffer->packed, size);
+
+	if(run_length_decode(buffer->packed, size, buffer->difference, buffer->state_size) != buffer->state_size)
+	{
+		// every older state is reached through this one, so they're all lost
+		LOG_ISSUE("a rewind state couldn't be decoded, so the states before it were dropped");
+		buffer->start = 0;
+		buffer->used = 0;
+		buffer->count = 0;
+		return false;
+	}
+	xor_states(buffer->newest, buffer->difference, buffer->newest, buffer->state_size);
+	COPY(buffer->newest, static_cast<unsigned char*>(state), buffer->state_size);
+
+	buffer->used -= entry_size;
+	buffer->count -= 1;
+	return true;
+}
@@ -0,0 +1,31 @@
+#ifndef REWIND_BUFFER_H
+#define REWIND_BUFFER_H
+
+#include <cstddef>
+
+// Keeps as many recent game states as fit in a fixed amount of memory, for
+// stepping back through them one at a time. Only the newest state is kept
+// whole. Every other state is stored as the XOR of itself with the state
+// after it, run-length encoded, and since most of a state stays the same
+// from one step to the next, that's mostly runs of zeros. XOR works the same
+// in both directions, so stepping back is just XORing the newest state with
+// the newest difference. Once memory runs out, the oldest states are dropped.
+
+struct RewindBuffer;
+
+RewindBuffer* create_rewind_buffer(size_t state_size, size_t capacity);
+void destroy_rewind_buffer(RewindBuffer* buffer);
+
+void push_rewind_state(RewindBuffer* buffer, const void* state);
+
+// Steps back to the state pushed before the newest one, which becomes the
+// newest, and copies it out. Returns false if there's nothing older left,
+// or if the older state was corrupt, in which case the state is left as is.
+bool pop_rewind_state(RewindBuffer* buffer, void* state);
+
+// how many states it's possible to step back
+int rewind_state_count(const RewindBuffer* buffer);
+
+void clear_rewind_buffer(RewindBuffer* buffer);
+
+#endif
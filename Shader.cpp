@@ -4,19 +4,49 @@
 #include "utilities/StringManipulation.h"
 
 #include <cstdio>
+#include <cstring>
+#include <cstdint>
 
-static GLuint load_shader(GLenum type, const char* filename)
+// Linked programs are saved to the cache directory alongside the shaders and
+// loaded back with glProgramBinary on the next run, which skips compiling and
+// linking altogether. Each binary is keyed by a hash of the shader sources and
+// the driver's vendor, renderer and version strings, so editing a shader or
+// updating the driver quietly falls back to compiling from source.
+
+#define SHADER_PATH "resources/shaders/"
+#define PROGRAM_CACHE_MAGIC 0x50474E4D // "MNGP"
+
+struct ProgramCacheHeader
+{
+	uint32_t magic;
+	uint32_t binary_format;
+	uint64_t key;
+	uint32_t binary_size;
+};
+
+// 64-bit FNV-1a
+static uint64_t hash_string(uint64_t hash, const char* string)
+{
+	for(const char* c = string; *c; ++c)
+	{
+		hash ^= static_cast<unsigned char>(*c);
+		hash *= 0x100000001B3;
+	}
+	return hash;
+}
+
+static char* load_source(const char* filename)
 {
 	// concatenate file name to base shader path
 	char path[128];
-	concatenate("resources/shaders/", filename, path);
+	concatenate(SHADER_PATH, filename, path);
 
 	// open shader file
 	FILE* file = fopen(path, "rb");
 	if(file == nullptr)
 	{
 		LOG_ISSUE("couldn't open shader file: %s", filename);
-		return 0;
+		return nullptr;
 	}
 
 	// get file size
@@ -25,15 +55,19 @@ static GLuint load_shader(GLenum type, const char* filename)
 	rewind(file);
 
 	// read shader source code and close file
-	GLchar* source_code = new GLchar[size + 1];
-	source_code[size] = '\0';
-	fread(source_code, 1, size, file);
+	char* source_code = new char[size + 1];
+	size_t read = fread(source_code, 1, size, file);
+	source_code[read] = '\0';
 	fclose(file);
 
+	return source_code;
+}
+
+static GLuint compile_shader(GLenum type, const char* filename, const char* source_code)
+{
 	// create shader, load source code to it, and compile
 	GLuint shader = glCreateShader(type);
 	glShaderSource(shader, 1, &source_code, nullptr);
-	delete[] source_code;
 	glCompileShader(shader);
 
 	// output shader errors if compile failed
@@ -60,16 +94,109 @@ static GLuint load_shader(GLenum type, const char* filename)
 	return shader;
 }
 
-GLuint load_shader_program(const char* vertex_file, const char* fragment_file)
+static bool program_cache_available()
+{
+	if(ogl_ext_ARB_get_program_binary != ogl_LOAD_SUCCEEDED)
+		return false;
+
+	// a driver can expose the extension but support no formats at all
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+static void get_cache_path(const char* vertex_file, const char* fragment_file, char* path, int capacity)
 {
-	GLuint vertex_shader = load_shader(GL_VERTEX_SHADER, vertex_file);
-	GLuint fragment_shader = load_shader(GL_FRAGMENT_SHADER, fragment_file);
+	snprintf(path, capacity, SHADER_PATH "cache/%s+%s.bin", vertex_file, fragment_file);
+}
+
+static GLuint load_cached_program(const char* path, uint64_t key)
+{
+	FILE* file = fopen(path, "rb");
+	if(file == nullptr)
+		return 0;
+
+	ProgramCacheHeader header;
+	if(fread(&header, sizeof header, 1, file) != 1 ||
+		header.magic != PROGRAM_CACHE_MAGIC || header.key != key ||
+		header.binary_size == 0)
+	{
+		fclose(file);
+		return 0;
+	}
+
+	char* binary = new char[header.binary_size];
+	size_t read = fread(binary, 1, header.binary_size, file);
+	fclose(file);
+	if(read != header.binary_size)
+	{
+		delete[] binary;
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, header.binary_format, binary, header.binary_size);
+	delete[] binary;
+
+	// the driver is free to reject a binary even when everything matched
+	GLint status = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if(status == GL_FALSE)
+	{
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return program;
+}
+
+static void save_cached_program(GLuint program, const char* path, uint64_t key)
+{
+	GLint binary_size = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binary_size);
+	if(binary_size <= 0)
+		return;
+
+	char* binary = new char[binary_size];
+	GLenum binary_format = 0;
+	GLsizei written = 0;
+	glGetProgramBinary(program, binary_size, &written, &binary_format, binary);
+
+	FILE* file = fopen(path, "wb");
+	if(file == nullptr)
+	{
+		LOG_ISSUE("couldn't open program cache file for writing: %s", path);
+		delete[] binary;
+		return;
+	}
+
+	ProgramCacheHeader header = {};
+	header.magic = PROGRAM_CACHE_MAGIC;
+	header.binary_format = binary_format;
+	header.key = key;
+	header.binary_size = written;
+	fwrite(&header, sizeof header, 1, file);
+	fwrite(binary, 1, written, file);
+	fclose(file);
+
+	delete[] binary;
+}
+
+static GLuint link_program(const char* vertex_file, const char* vertex_source,
+	const char* fragment_file, const char* fragment_source, bool retrievable)
+{
+	GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER, vertex_file, vertex_source);
+	GLuint fragment_shader = compile_shader(GL_FRAGMENT_SHADER, fragment_file, fragment_source);
 
 	GLuint program = 0;
 	if(vertex_shader != 0 && fragment_shader != 0)
 	{
 		// create program object and link shaders to it
 		program = glCreateProgram();
+		if(retrievable)
+		{
+			glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
 		glAttachShader(program, vertex_shader);
 		glAttachShader(program, fragment_shader);
 		glLinkProgram(program);
@@ -106,4 +233,51 @@ GLuint load_shader_program(const char* vertex_file, const char* fragment_file)
 	glDeleteShader(fragment_shader);
 
 	return program;
-}
\ No newline at end of file
+}
+
+GLuint load_shader_program(const char* vertex_file, const char* fragment_file)
+{
+	char* vertex_source = load_source(vertex_file);
+	char* fragment_source = load_source(fragment_file);
+	if(vertex_source == nullptr || fragment_source == nullptr)
+	{
+		delete[] vertex_source;
+		delete[] fragment_source;
+		return 0;
+	}
+
+	GLuint program = 0;
+	if(program_cache_available())
+	{
+		uint64_t key = 0xCBF29CE484222325;
+		key = hash_string(key, vertex_source);
+		key = hash_string(key, fragment_source);
+		key = hash_string(key, reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+		key = hash_string(key, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+		key = hash_string(key, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+
+		char path[256];
+		get_cache_path(vertex_file, fragment_file, path, sizeof path);
+
+		program = load_cached_program(path, key);
+		if(program == 0)
+		{
+			program = link_program(vertex_file, vertex_source,
+				fragment_file, fragment_source, true);
+			if(program != 0)
+			{
+				save_cached_program(program, path, key);
+			}
+		}
+	}
+	else
+	{
+		program = link_program(vertex_file, vertex_source,
+			fragment_file, fragment_source, false);
+	}
+
+	delete[] vertex_source;
+	delete[] fragment_source;
+
+	return program;
+}
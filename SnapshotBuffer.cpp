@@ -0,0 +1,238 @@
+#include "SnapshotBuffer.h"
+
+#include "utilities/ArrayMacros.h"
+#include "utilities/StringManipulation.h"
+
+#include <atomic>
+
+// set in the middle index when it holds a snapshot the reader hasn't taken
+#define SNAPSHOT_FRESH 4
+#define SNAPSHOT_INDEX 3
+
+struct Snapshot
+{
+	Sprite sprites[MAX_SPRITES];
+	PaletteRam palettes;
+	byte_t scroll_x, scroll_y;
+	byte_t sprite_scan_start;
+	char background_tileset[128];
+	char sprite_tileset[128];
+
+	// With load_map set, the whole map follows as one rectangle. The tiles of
+	// each rectangle are stored row by row, followed by its attributes.
+	bool load_map;
+	int columns, rows;
+	TileRect rects[MAX_DIRTY_RECTS];
+	int rect_count;
+	byte_t* tile_data;
+	size_t tile_data_capacity;
+};
+
+struct SnapshotBuffer
+{
+	Snapshot snapshots[3];
+	int back; // only touched by the simulation thread
+	std::atomic<int> middle;
+	int front; // only touched by the render thread
+
+	// the render side's copies of the tilemap and palette RAM
+	Tilemap tilemap;
+	PaletteRam palettes;
+};
+
+SnapshotBuffer* create_snapshot_buffer()
+{
+	SnapshotBuffer* buffer = new SnapshotBuffer;
+	for(int i = 0; i < 3; ++i)
+	{
+		Snapshot& snapshot = buffer->snapshots[i];
+		snapshot.tile_data = nullptr;
+		snapshot.tile_data_capacity = 0;
+	}
+	buffer->back = 0;
+	buffer->middle = 1;
+	buffer->front = 2;
+
+	buffer->tilemap = {};
+	reset_palettes(buffer->palettes);
+
+	return buffer;
+}
+
+void destroy_snapshot_buffer(SnapshotBuffer* buffer)
+{
+	if(buffer == nullptr) return;
+
+	for(int i = 0; i < 3; ++i)
+	{
+		delete[] buffer->snapshots[i].tile_data;
+	}
+	if(buffer->tilemap.tiles != nullptr)
+	{
+		unload_tilemap(buffer->tilemap);
+	}
+
+	delete buffer;
+}
+
+static inline int rect_tile_count(const TileRect& rect)
+{
+	return (rect.right - rect.left) * (rect.bottom - rect.top);
+}
+
+static void copy_rect_out(const Tilemap& map, const TileRect& rect, byte_t* tiles, byte_t* attributes)
+{
+	int width = rect.right - rect.left;
+	for(int y = rect.top; y < rect.bottom; ++y)
+	{
+		int offset = y * map.columns + rect.left;
+		COPY(map.tiles + offset, tiles, width);
+		COPY(map.attributes + offset, attributes, width);
+		tiles += width;
+		attributes += width;
+	}
+}
+
+static void copy_rect_in(Tilemap& map, const TileRect& rect, const byte_t* tiles, const byte_t* attributes)
+{
+	int width = rect.right - rect.left;
+	for(int y = rect.top; y < rect.bottom; ++y)
+	{
+		int offset = y * map.columns + rect.left;
+		COPY(tiles, map.tiles + offset, width);
+		COPY(attributes, map.attributes + offset, width);
+		tiles += width;
+		attributes += width;
+	}
+}
+
+void publish_snapshot(SnapshotBuffer* buffer, Game::GameState& state)
+{
+	Tilemap& map = *state.tilemap;
+
+	// If the last snapshot is still sitting there untaken, this one replaces
+	// it, so anything it changed has to go out again. Should the renderer
+	// take it after all, the same tiles are just copied twice.
+	bool load_map = state.load_map;
+	{
+		int middle = buffer->middle.load();
+		if(middle & SNAPSHOT_FRESH)
+		{
+			const Snapshot& unread = buffer->snapshots[middle & SNAPSHOT_INDEX];
+			load_map = load_map || unread.load_map;
+			for(int i = 0; i < unread.rect_count; ++i)
+			{
+				const TileRect& rect = unread.rects[i];
+				mark_tiles_dirty(map, rect.left, rect.top, rect.right - rect.left, rect.bottom - rect.top);
+			}
+		}
+	}
+
+	Snapshot& snapshot = buffer->snapshots[buffer->back];
+	COPY(state.sprites, snapshot.sprites, MAX_SPRITES);
+	snapshot.palettes = *state.palettes;
+	snapshot.scroll_x = state.scroll_x;
+	snapshot.scroll_y = state.scroll_y;
+	snapshot.sprite_scan_start = state.sprite_scan_start;
+	copy_string(state.background_tileset, snapshot.background_tileset, sizeof snapshot.background_tileset);
+	copy_string(state.sprite_tileset, snapshot.sprite_tileset, sizeof snapshot.sprite_tileset);
+
+	snapshot.load_map = load_map;
+	snapshot.columns = map.columns;
+	snapshot.rows = map.rows;
+	if(load_map)
+	{
+		TileRect whole_map = { 0, 0, map.columns, map.rows };
+		snapshot.rects[0] = whole_map;
+		snapshot.rect_count = 1;
+	}
+	else
+	{
+		COPY(map.dirty_rects, snapshot.rects, map.dirty_rect_count);
+		snapshot.rect_count = map.dirty_rect_count;
+	}
+
+	// the tile data only ever grows, to the most any one frame has needed
+	size_t tile_count = 0;
+	for(int i = 0; i < snapshot.rect_count; ++i)
+	{
+		tile_count += rect_tile_count(snapshot.rects[i]);
+	}
+	if(2 * tile_count > snapshot.tile_data_capacity)
+	{
+		delete[] snapshot.tile_data;
+		snapshot.tile_data_capacity = 2 * tile_count;
+		snapshot.tile_data = new byte_t[snapshot.tile_data_capacity];
+	}
+
+	byte_t* data = snapshot.tile_data;
+	for(int i = 0; i < snapshot.rect_count; ++i)
+	{
+		int count = rect_tile_count(snapshot.rects[i]);
+		copy_rect_out(map, snapshot.rects[i], data, data + count);
+		data += 2 * count;
+	}
+
+	clear_dirty_tiles(map);
+	clear_dirty_colors(*state.palettes);
+
+	int previous = buffer->middle.exchange(buffer->back | SNAPSHOT_FRESH);
+	buffer->back = previous & SNAPSHOT_INDEX;
+}
+
+bool acquire_snapshot(SnapshotBuffer* buffer, Game::GameState& state)
+{
+	if(!(buffer->middle.load() & SNAPSHOT_FRESH))
+		return false;
+
+	int previous = buffer->middle.exchange(buffer->front);
+	buffer->front = previous & SNAPSHOT_INDEX;
+
+	const Snapshot& snapshot = buffer->snapshots[buffer->front];
+
+	// bring the render side's tilemap up to date
+	Tilemap& map = buffer->tilemap;
+	if(snapshot.load_map)
+	{
+		if(map.tiles != nullptr)
+		{
+			unload_tilemap(map);
+		}
+		map = create_tilemap(snapshot.columns, snapshot.rows);
+	}
+
+	const byte_t* data = snapshot.tile_data;
+	for(int i = 0; i < snapshot.rect_count; ++i)
+	{
+		const TileRect& rect = snapshot.rects[i];
+		int count = rect_tile_count(rect);
+		copy_rect_in(map, rect, data, data + count);
+		data += 2 * count;
+
+		if(!snapshot.load_map)
+		{
+			mark_tiles_dirty(map, rect.left, rect.top, rect.right - rect.left, rect.bottom - rect.top);
+		}
+	}
+
+	// only colours that differ from what the renderer last saw are marked
+	for(int i = 0; i < 2 * PALETTE_COUNT; ++i)
+	{
+		for(int j = 0; j < COLORS_PER_PALETTE; ++j)
+		{
+			set_palette_color(buffer->palettes, i, j, snapshot.palettes.colors[i][j]);
+		}
+	}
+
+	state.sprites = const_cast<Sprite*>(snapshot.sprites);
+	state.tilemap = &map;
+	state.palettes = &buffer->palettes;
+	state.scroll_x = snapshot.scroll_x;
+	state.scroll_y = snapshot.scroll_y;
+	state.sprite_scan_start = snapshot.sprite_scan_start;
+	state.load_map = snapshot.load_map;
+	state.background_tileset = snapshot.background_tileset;
+	state.sprite_tileset = snapshot.sprite_tileset;
+
+	return true;
+}
@@ -0,0 +1,30 @@
+#ifndef SNAPSHOT_BUFFER_H
+#define SNAPSHOT_BUFFER_H
+
+#include "Game.h"
+
+// Hands frames from the simulation thread to the render thread. Each frame is
+// copied by value into a snapshot, so the game is free to carry on changing
+// its state while the renderer still draws the last one. There are three
+// snapshots: one being written, one being read, and the latest finished one
+// in between, which each side swaps with its own without any locking.
+//
+// A snapshot only carries the tiles that changed, and the render side keeps
+// its own copy of the tilemap up to date with them. A snapshot the renderer
+// never got around to taking has its changes sent again with the next one.
+
+struct SnapshotBuffer;
+
+SnapshotBuffer* create_snapshot_buffer();
+void destroy_snapshot_buffer(SnapshotBuffer* buffer);
+
+// Called from the simulation thread after each update. This takes over
+// clearing the dirty tiles and colours in the game's state.
+void publish_snapshot(SnapshotBuffer* buffer, Game::GameState& state);
+
+// Called from the render thread. Returns false if nothing newer has been
+// published since the last call, otherwise fills in a state to render which
+// stays valid until the next time this returns true.
+bool acquire_snapshot(SnapshotBuffer* buffer, Game::GameState& state);
+
+#endif
@@ -0,0 +1,469 @@
+#include "SoftwareRenderSystem.h"
+#include "TilePatterns.h"
+#include "PaletteRam.h"
+#include "Tilemap.h"
+#include "Sprite.h"
+#include "OamScan.h"
+
+#include "utilities/ArrayMacros.h"
+#include "utilities/StringManipulation.h"
+#include "utilities/Logging.h"
+#include "utilities/WorkerPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <cstdint>
+
+#define TILE_DIMENSION 8
+
+// Pixels are kept as RGBA bytes, so on a little-endian machine the alpha
+// channel ends up in the high byte of each 32-bit pixel. Colour 0 of every
+// palette is stored without alpha to mark it as transparent while the line is
+// being composited, and only gets its alpha once the line is finished.
+#define ALPHA_MASK  0xFF000000u
+#define CLEAR_COLOR 0xFFFF00FFu
+
+// Wide enough that a sprite at the right-most position (255) doesn't need
+// clipping, with a tile's worth of room before the start of the line for the
+// part of the first background tile that's scrolled off the left edge.
+#define MAX_FRAME_WIDTH 256
+#define LINE_START      TILE_DIMENSION
+#define LINE_WIDTH      (LINE_START + MAX_FRAME_WIDTH + TILE_DIMENSION)
+
+// Frames are split into bands of this many scanlines which are handed out to
+// the worker threads. A band of one tile row keeps every band roughly equal
+// in cost while still leaving enough of them to balance between threads.
+#define BAND_HEIGHT TILE_DIMENSION
+
+#define MAX_FAILED_TILESETS 4
+
+namespace SoftwareRenderSystem {
+
+namespace
+{
+	typedef uint32_t pixel_t;
+
+	// Everything needed to composite one scanline. "opaque" marks background
+	// colours 1-3 and "above" marks the ones whose tile has TILE_BG_PRIORITY
+	// set.
+	struct LineBuffer
+	{
+		pixel_t color[LINE_WIDTH];
+		pixel_t opaque[LINE_WIDTH];
+		pixel_t above[LINE_WIDTH];
+	};
+
+	// the last two tilesets used, which is enough for the background and
+	// sprites to each have their own
+	struct Tileset
+	{
+		TilePatterns patterns;
+		char filename[128];
+	};
+	Tileset tilesets[2];
+	const TilePatterns* background_patterns;
+	const TilePatterns* sprite_patterns;
+
+	// Tilesets are loaded into here first, so that one that fails partway
+	// doesn't leave either pass drawing with half its patterns.
+	TilePatterns loading_patterns;
+
+	// the last few tilesets that failed to load, so each is only tried once
+	char failed_tilesets[MAX_FAILED_TILESETS][128];
+	int failed_tileset_count;
+
+	// background palettes 0-7 followed by object palettes 0-7
+	pixel_t palettes[2 * PALETTE_COUNT][COLORS_PER_PALETTE];
+
+#if !defined(USE_SSE2)
+	// bitplane bytes spread out to a nibble per pixel, then the same mirrored
+	uint32_t spread[2][256];
+#endif
+
+	pixel_t* frame = nullptr;
+	int frame_width, frame_height;
+
+	WorkerPool* workers = nullptr;
+	ScanlineSprites scanlines;
+}
+
+static inline pixel_t rgb555_to_pixel(word_t color)
+{
+	// widen each 5-bit channel to 8 bits, rounding the same way the GPU does
+	pixel_t red = ((color & 31) * 255 + 15) / 31;
+	pixel_t green = (((color >> 5) & 31) * 255 + 15) / 31;
+	pixel_t blue = (((color >> 10) & 31) * 255 + 15) / 31;
+	return red | green << 8 | blue << 16 | ALPHA_MASK;
+}
+
+static void update_palettes(PaletteRam& ram)
+{
+	for(int i = 0; i < PALETTE_RAM_COLORS; ++i)
+	{
+		if(!(ram.dirty & (1ull << i))) continue;
+
+		int palette = i / COLORS_PER_PALETTE;
+		int index = i % COLORS_PER_PALETTE;
+		pixel_t color = rgb555_to_pixel(ram.colors[palette][index]);
+		palettes[palette][index] = (index == 0) ? color & ~ALPHA_MASK : color;
+	}
+	clear_dirty_colors(ram);
+}
+
+#if defined(USE_SSE2)
+
+static inline __m128i decode_pixels(__m128i low, __m128i high, __m128i bits, const pixel_t colors[COLORS_PER_PALETTE])
+{
+	// Pick between the four colours without branching: each bitplane that's
+	// set flips the colour from colour 0 towards the one it selects.
+	__m128i low_set = _mm_cmpeq_epi32(_mm_and_si128(low, bits), bits);
+	__m128i high_set = _mm_cmpeq_epi32(_mm_and_si128(high, bits), bits);
+
+	__m128i color = _mm_set1_epi32(colors[0]);
+	color = _mm_xor_si128(color, _mm_and_si128(low_set, _mm_set1_epi32(colors[0] ^ colors[1])));
+	color = _mm_xor_si128(color, _mm_and_si128(high_set, _mm_set1_epi32(colors[0] ^ colors[2])));
+	__m128i both = _mm_and_si128(low_set, high_set);
+	return _mm_xor_si128(color, _mm_and_si128(both, _mm_set1_epi32(colors[0] ^ colors[1] ^ colors[2] ^ colors[3])));
+}
+
+static inline void decode_pattern_row(const byte_t* pattern, int row, bool flip, const pixel_t colors[COLORS_PER_PALETTE], __m128i& left, __m128i& right)
+{
+	// bit 7 of each bitplane is the left-most pixel
+	__m128i low = _mm_set1_epi32(pattern[2 * row]);
+	__m128i high = _mm_set1_epi32(pattern[2 * row + 1]);
+	if(flip)
+	{
+		left = decode_pixels(low, high, _mm_setr_epi32(0x01, 0x02, 0x04, 0x08), colors);
+		right = decode_pixels(low, high, _mm_setr_epi32(0x10, 0x20, 0x40, 0x80), colors);
+	}
+	else
+	{
+		left = decode_pixels(low, high, _mm_setr_epi32(0x80, 0x40, 0x20, 0x10), colors);
+		right = decode_pixels(low, high, _mm_setr_epi32(0x08, 0x04, 0x02, 0x01), colors);
+	}
+}
+
+static inline __m128i opaque_mask(__m128i texels)
+{
+	__m128i alpha = _mm_and_si128(texels, _mm_set1_epi32(ALPHA_MASK));
+	__m128i transparent = _mm_cmpeq_epi32(alpha, _mm_setzero_si128());
+	return _mm_xor_si128(transparent, _mm_set1_epi32(-1));
+}
+
+static inline void store_background(__m128i texels, __m128i priority, pixel_t* color, pixel_t* opaque, pixel_t* above)
+{
+	__m128i mask = opaque_mask(texels);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(color), texels);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(opaque), mask);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(above), _mm_and_si128(mask, priority));
+}
+
+static inline void blend_sprite(__m128i texels, bool behind, pixel_t* color, const pixel_t* opaque, const pixel_t* above)
+{
+	__m128i blocked = _mm_loadu_si128(reinterpret_cast<const __m128i*>(above));
+	if(behind)
+		blocked = _mm_or_si128(blocked, _mm_loadu_si128(reinterpret_cast<const __m128i*>(opaque)));
+
+	__m128i write = _mm_andnot_si128(blocked, opaque_mask(texels));
+	__m128i old = _mm_loadu_si128(reinterpret_cast<const __m128i*>(color));
+	__m128i result = _mm_or_si128(_mm_and_si128(write, texels), _mm_andnot_si128(write, old));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(color), result);
+}
+
+#else
+
+static void make_spread_tables()
+{
+	// Each bit of a byte is moved to its own nibble, left-most pixel first, so
+	// that both bitplanes of a row can be combined into eight colour numbers
+	// at once. Bit 7 of a bitplane is the left-most pixel.
+	for(int value = 0; value < 256; ++value)
+	{
+		uint32_t forward = 0, reversed = 0;
+		for(int i = 0; i < TILE_DIMENSION; ++i)
+		{
+			uint32_t bit = (value >> (7 - i)) & 1;
+			forward |= bit << (4 * i);
+			reversed |= bit << (4 * (TILE_DIMENSION - 1 - i));
+		}
+		spread[0][value] = forward;
+		spread[1][value] = reversed;
+	}
+}
+
+static inline void decode_pattern_row(const byte_t* pattern, int row, bool flip, const pixel_t colors[COLORS_PER_PALETTE], pixel_t texels[TILE_DIMENSION])
+{
+	const uint32_t* table = spread[flip];
+	uint32_t numbers = table[pattern[2 * row]] | table[pattern[2 * row + 1]] << 1;
+	for(int i = 0; i < TILE_DIMENSION; ++i)
+	{
+		texels[i] = colors[numbers & 3];
+		numbers >>= 4;
+	}
+}
+
+#endif
+
+static void draw_background_line(const Tilemap& map, int scroll_x, int scroll_y, int line, LineBuffer& buffer)
+{
+	// the background wraps around at its edges, like the hardware's 32x32 map
+	int map_width = map.columns * TILE_DIMENSION;
+	int map_height = map.rows * TILE_DIMENSION;
+	int y = (map_height > 0) ? (line + scroll_y) % map_height : 0;
+	int tile_y = y / TILE_DIMENSION;
+	int fine_y = y % TILE_DIMENSION;
+
+	int first_x = (map_width > 0) ? scroll_x % map_width : 0;
+	int fine_x = first_x % TILE_DIMENSION;
+	int tiles_across = (fine_x + frame_width + TILE_DIMENSION - 1) / TILE_DIMENSION;
+
+	for(int column = 0; column < tiles_across; ++column)
+	{
+		int x = LINE_START + column * TILE_DIMENSION - fine_x;
+		pixel_t* color = buffer.color + x;
+		pixel_t* opaque = buffer.opaque + x;
+		pixel_t* above = buffer.above + x;
+
+		// without a map there's nothing to draw but the clear colour
+		if(map.tiles == nullptr || map_width == 0)
+		{
+			for(int i = 0; i < TILE_DIMENSION; ++i)
+			{
+				color[i] = CLEAR_COLOR;
+				opaque[i] = 0;
+				above[i] = 0;
+			}
+			continue;
+		}
+
+		// Background tiles are numbered from 128 to 383
+		int tile_x = (first_x / TILE_DIMENSION + column) % map.columns;
+		int tile_index = tile_y * map.columns + tile_x;
+		int tile_number = 128 + map.tiles[tile_index];
+		byte_t attribute = map.attributes[tile_index];
+
+		int row = (attribute & TILE_VERTICAL_FLIP) ? TILE_DIMENSION - 1 - fine_y : fine_y;
+		const byte_t* pattern = find_pattern(*background_patterns, (attribute & TILE_BANK) != 0, tile_number);
+		bool flip = (attribute & TILE_HORIZONTAL_FLIP) != 0;
+
+		const pixel_t* colors = palettes[attribute & TILE_PALETTE];
+
+#if defined(USE_SSE2)
+		__m128i left, right;
+		decode_pattern_row(pattern, row, flip, colors, left, right);
+		__m128i priority = _mm_set1_epi32((attribute & TILE_BG_PRIORITY) ? -1 : 0);
+		store_background(left, priority, color, opaque, above);
+		store_background(right, priority, color + 4, opaque + 4, above + 4);
+#else
+		pixel_t texels[TILE_DIMENSION];
+		decode_pattern_row(pattern, row, flip, colors, texels);
+
+		pixel_t priority = (attribute & TILE_BG_PRIORITY) ? ~0u : 0u;
+		for(int i = 0; i < TILE_DIMENSION; ++i)
+		{
+			pixel_t texel = texels[i];
+			pixel_t mask = (texel & ALPHA_MASK) ? ~0u : 0u;
+			color[i] = texel;
+			opaque[i] = mask;
+			above[i] = mask & priority;
+		}
+#endif
+	}
+}
+
+static void draw_sprite_line(const Sprite& sprite, int line, LineBuffer& buffer)
+{
+	byte_t attribute = sprite.attribute;
+
+	int fine_y = line - sprite.position_y;
+	int row = (attribute & SPRITE_VERTICAL_FLIP) ? TILE_DIMENSION - 1 - fine_y : fine_y;
+
+	// Sprite tiles are numbered from 0 to 255, and use the object palettes
+	const byte_t* pattern = find_pattern(*sprite_patterns, (attribute & SPRITE_BANK) != 0, sprite.tile_number);
+	bool flip = (attribute & SPRITE_HORIZONTAL_FLIP) != 0;
+	bool behind = (attribute & SPRITE_BG_PRIORITY) != 0;
+
+	const pixel_t* colors = palettes[PALETTE_COUNT + (attribute & SPRITE_PALETTE)];
+
+	int x = LINE_START + sprite.position_x;
+	pixel_t* color = buffer.color + x;
+	const pixel_t* opaque = buffer.opaque + x;
+	const pixel_t* above = buffer.above + x;
+
+#if defined(USE_SSE2)
+	__m128i left, right;
+	decode_pattern_row(pattern, row, flip, colors, left, right);
+	blend_sprite(left, behind, color, opaque, above);
+	blend_sprite(right, behind, color + 4, opaque + 4, above + 4);
+#else
+	pixel_t texels[TILE_DIMENSION];
+	decode_pattern_row(pattern, row, flip, colors, texels);
+
+	for(int i = 0; i < TILE_DIMENSION; ++i)
+	{
+		pixel_t texel = texels[i];
+		bool blocked = above[i] || (behind && opaque[i]);
+		if((texel & ALPHA_MASK) && !blocked)
+			color[i] = texel;
+	}
+#endif
+}
+
+static void resolve_line(const LineBuffer& buffer, pixel_t* out)
+{
+	int x = 0;
+#if defined(USE_SSE2)
+	__m128i alpha = _mm_set1_epi32(ALPHA_MASK);
+	for(; x + 4 <= frame_width; x += 4)
+	{
+		__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buffer.color + LINE_START + x));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_or_si128(pixels, alpha));
+	}
+#endif
+	for(; x < frame_width; ++x)
+		out[x] = buffer.color[LINE_START + x] | ALPHA_MASK;
+}
+
+static void render_lines(const Game::GameState& game, int first_line, int end_line)
+{
+	LineBuffer buffer = {};
+
+	for(int line = first_line; line < end_line; ++line)
+	{
+		draw_background_line(*game.tilemap, game.scroll_x, game.scroll_y, line, buffer);
+
+		// Each line's sprites are listed highest priority first, so walk them
+		// backwards to have the higher ones end up drawn over the rest.
+		if(line < scanlines.line_count)
+		{
+			const byte_t* drawn = scanlines.sprites[line];
+			for(int i = scanlines.counts[line] - 1; i >= 0; --i)
+			{
+				draw_sprite_line(game.sprites[drawn[i]], line, buffer);
+			}
+		}
+
+		resolve_line(buffer, frame + line * frame_width);
+	}
+}
+
+static void render_band(int band, void* data)
+{
+	int first_line = band * BAND_HEIGHT;
+	int end_line = first_line + BAND_HEIGHT;
+	if(end_line > frame_height)
+		end_line = frame_height;
+
+	const Game::GameState* game = static_cast<const Game::GameState*>(data);
+	render_lines(*game, first_line, end_line);
+}
+
+bool Initialise(int target_width, int target_height, int scale)
+{
+	// frames are only ever produced at their native resolution
+	(void) scale;
+
+	if(target_width <= 0 || target_width > MAX_FRAME_WIDTH || target_height <= 0)
+	{
+		LOG_ISSUE("software renderer can't make a %ix%i frame", target_width, target_height);
+		return false;
+	}
+
+	frame_width = target_width;
+	frame_height = target_height;
+
+	frame = new pixel_t[frame_width * frame_height];
+	FILL(frame, frame_width * frame_height, 0xFF);
+
+	CLEAR_ARRAY(tilesets);
+	CLEAR_ARRAY(failed_tilesets);
+	failed_tileset_count = 0;
+	background_patterns = &tilesets[0].patterns;
+	sprite_patterns = &tilesets[0].patterns;
+	CLEAR_ARRAY(palettes);
+#if !defined(USE_SSE2)
+	make_spread_tables();
+#endif
+
+	workers = create_worker_pool(1);
+
+	return true;
+}
+
+void Terminate()
+{
+	destroy_worker_pool(workers);
+	workers = nullptr;
+
+	delete[] frame;
+	frame = nullptr;
+}
+
+void Set_Thread_Count(int thread_count)
+{
+	destroy_worker_pool(workers);
+	workers = create_worker_pool(thread_count);
+}
+
+// Returns the patterns for a pass to draw with, which stay the ones it used
+// last when it doesn't name a tileset or the one it names can't be loaded.
+static const TilePatterns* use_tileset(const char* filename, const TilePatterns* previous, const TilePatterns* other_pass)
+{
+	if(filename == nullptr)
+		return previous;
+
+	for(int i = 0; i < static_cast<int>(ARRAY_COUNT(tilesets)); ++i)
+	{
+		if(strcmp(tilesets[i].filename, filename) == 0)
+			return &tilesets[i].patterns;
+	}
+
+	for(int i = 0; i < failed_tileset_count && i < MAX_FAILED_TILESETS; ++i)
+	{
+		if(strcmp(failed_tilesets[i], filename) == 0)
+			return previous;
+	}
+
+	if(!load_tile_patterns(filename, loading_patterns))
+	{
+		char* failed = failed_tilesets[failed_tileset_count % MAX_FAILED_TILESETS];
+		copy_string(filename, failed, sizeof failed_tilesets[0]);
+		failed_tileset_count += 1;
+		return previous;
+	}
+
+	// load over whichever tileset the other pass isn't using
+	Tileset& tileset = (other_pass == &tilesets[0].patterns) ? tilesets[1] : tilesets[0];
+	tileset.patterns = loading_patterns;
+	copy_string(filename, tileset.filename, sizeof tileset.filename);
+
+	return &tileset.patterns;
+}
+
+void Update(const Game::GameState& game)
+{
+	// check game state for anything new
+	background_patterns = use_tileset(game.background_tileset, background_patterns, sprite_patterns);
+	sprite_patterns = use_tileset(game.sprite_tileset, sprite_patterns, background_patterns);
+
+	if(game.palettes->dirty != 0)
+	{
+		update_palettes(*game.palettes);
+	}
+
+	// every band reads from the same scan, so it's done once up front
+	scan_oam(game.sprites, frame_height, game.sprite_scan_start, scanlines);
+
+	int band_count = (frame_height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+	run_jobs(workers, render_band, const_cast<Game::GameState*>(&game), band_count);
+}
+
+const byte_t* Get_Frame()
+{
+	return reinterpret_cast<const byte_t*>(frame);
+}
+
+} // namespace SoftwareRenderSystem
@@ -0,0 +1,22 @@
+#ifndef SOFTWARE_RENDER_SYSTEM_H
+#define SOFTWARE_RENDER_SYSTEM_H
+
+#include "Game.h"
+
+// Draws the same frame as RenderSystem, but entirely on the CPU so it can run
+// on machines without a GPU. Frames are composited one scanline at a time into
+// a target_width x target_height image of RGBA bytes, which is never scaled.
+// Bands of scanlines are rendered in parallel once Set_Thread_Count is given
+// more than the default of one thread.
+namespace SoftwareRenderSystem
+{
+	bool Initialise(int target_width, int target_height, int scale);
+	void Terminate();
+	void Update(const Game::GameState& game);
+
+	void Set_Thread_Count(int thread_count);
+
+	const byte_t* Get_Frame();
+}
+
+#endif
@@ -3,9 +3,16 @@
 
 #include "gl_core_3_3.h"
 #include "Mesh.h"
+#include "RenderCommands.h"
 #include "Sprite.h"
+#include "OamScan.h"
 
 Mesh create_sprite_batch_mesh();
-void buffer_sprites(const Sprite sprites[], GLuint buffer);
+
+// Sprites are sent lowest priority first, so the ones drawn over the others
+// come last, along with which of their rows the scan let through.
+void buffer_sprites(const Sprite sprites[], const ScanlineSprites& scanlines, GLuint buffer);
+
+void set_sprite_batch_draw(DrawCommand& command, const Mesh& mesh);
 
 #endif
@@ -0,0 +1,65 @@
+#include "TilePatterns.h"
+#include "Image.h"
+
+#include "utilities/ArrayMacros.h"
+#include "utilities/Logging.h"
+
+#define TILE_DIMENSION   8
+#define PATTERN_COUNT_X  16 // per bank
+#define PATTERN_COUNT_Y  24
+#define BANK_WIDTH       (TILE_DIMENSION * PATTERN_COUNT_X)
+#define IMAGE_WIDTH      (PATTERN_BANK_COUNT * BANK_WIDTH)
+#define IMAGE_HEIGHT     (TILE_DIMENSION * PATTERN_COUNT_Y)
+
+static int shade_of(const byte_t* pixel)
+{
+	if(pixel[3] == 0) return 0;
+
+	// rough luma, split evenly into the three opaque colours
+	int luma = (2 * pixel[0] + 5 * pixel[1] + pixel[2]) / 8;
+	return 1 + luma * 3 / 256;
+}
+
+bool load_tile_patterns(const char* filename, TilePatterns& patterns)
+{
+	int width, height;
+	byte_t* pixels = static_cast<byte_t*>(load_image(filename, &width, &height, 4));
+	if(pixels == nullptr)
+		return false;
+
+	if(width != IMAGE_WIDTH || height != IMAGE_HEIGHT)
+	{
+		LOG_ISSUE("tile patterns %s are %ix%i but must be %ix%i", filename, width, height, IMAGE_WIDTH, IMAGE_HEIGHT);
+		unload_image(pixels);
+		return false;
+	}
+
+	for(int bank = 0; bank < PATTERN_BANK_COUNT; ++bank)
+	{
+		for(int tile = 0; tile < PATTERNS_PER_BANK; ++tile)
+		{
+			int left = bank * BANK_WIDTH + (tile % PATTERN_COUNT_X) * TILE_DIMENSION;
+			int top = (tile / PATTERN_COUNT_X) * TILE_DIMENSION;
+			byte_t* pattern = patterns.banks[bank] + tile * PATTERN_SIZE;
+
+			for(int row = 0; row < TILE_DIMENSION; ++row)
+			{
+				const byte_t* pixel = pixels + 4 * ((top + row) * IMAGE_WIDTH + left);
+
+				byte_t low = 0, high = 0;
+				for(int i = 0; i < TILE_DIMENSION; ++i, pixel += 4)
+				{
+					int shade = shade_of(pixel);
+					low |= (shade & 1) << (7 - i);
+					high |= (shade >> 1) << (7 - i);
+				}
+				pattern[2 * row] = low;
+				pattern[2 * row + 1] = high;
+			}
+		}
+	}
+
+	unload_image(pixels);
+
+	return true;
+}
@@ -0,0 +1,32 @@
+#ifndef TILE_PATTERNS_H
+#define TILE_PATTERNS_H
+
+#include "GameBoyTypes.h"
+
+// Tile patterns are stored the way they are in CGB VRAM: two banks of 384
+// tiles, each tile 8 rows of two bytes. The first byte of a row holds the low
+// bit of every pixel's colour number and the second byte the high bit, with
+// the left-most pixel in bit 7. Colour numbers are looked up in one of the
+// palettes in PaletteRam chosen by a tile's or sprite's attribute to get the
+// actual colour.
+
+#define PATTERN_BANK_COUNT 2
+#define PATTERNS_PER_BANK  384
+#define PATTERN_SIZE       16 // bytes
+
+struct TilePatterns
+{
+	byte_t banks[PATTERN_BANK_COUNT][PATTERNS_PER_BANK * PATTERN_SIZE];
+};
+
+// Converts an RGBA pattern image, with the banks side-by-side, into 2bpp
+// patterns. Transparent pixels become colour 0 and the rest are sorted into
+// colours 1-3 by how bright they are.
+bool load_tile_patterns(const char* filename, TilePatterns& patterns);
+
+static inline const byte_t* find_pattern(const TilePatterns& patterns, bool second_bank, int tile_number)
+{
+	return patterns.banks[second_bank] + tile_number * PATTERN_SIZE;
+}
+
+#endif
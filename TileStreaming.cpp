@@ -0,0 +1,170 @@
+#include "TileStreaming.h"
+
+#define TILE_DIMENSION 8
+
+static inline int wrap(int value, int size)
+{
+	int result = value % size;
+	return (result < 0) ? result + size : result;
+}
+
+static inline int floor_divide(int value, int divisor)
+{
+	int quotient = value / divisor;
+	return (value % divisor < 0) ? quotient - 1 : quotient;
+}
+
+static void fetch_from_tilemap(const void* world, int x, int y, byte_t& tile, byte_t& attribute)
+{
+	const Tilemap& map = *static_cast<const Tilemap*>(world);
+
+	// anything past the edges of the world is left blank
+	if(x < 0 || x >= map.columns || y < 0 || y >= map.rows)
+	{
+		tile = 0;
+		attribute = 0;
+		return;
+	}
+
+	int index = y * map.columns + x;
+	tile = map.tiles[index];
+	attribute = map.attributes[index];
+}
+
+static inline void copy_tile(const TileStream& stream, Tilemap& ring, int world_x, int world_y)
+{
+	int ring_index = wrap(world_y, ring.rows) * ring.columns + wrap(world_x, ring.columns);
+	stream.fetch(stream.world, world_x, world_y, ring.tiles[ring_index], ring.attributes[ring_index]);
+}
+
+static void stream_column(const TileStream& stream, Tilemap& ring, int world_x)
+{
+	for(int y = stream.origin_y; y < stream.origin_y + ring.rows; ++y)
+		copy_tile(stream, ring, world_x, y);
+	mark_tiles_dirty(ring, wrap(world_x, ring.columns), 0, 1, ring.rows);
+}
+
+static void stream_row(const TileStream& stream, Tilemap& ring, int world_y)
+{
+	for(int x = stream.origin_x; x < stream.origin_x + ring.columns; ++x)
+		copy_tile(stream, ring, x, world_y);
+	mark_tiles_dirty(ring, 0, wrap(world_y, ring.rows), ring.columns, 1);
+}
+
+TileStream begin_tile_stream(const Tilemap* world)
+{
+	return begin_tile_stream(fetch_from_tilemap, world);
+}
+
+TileStream begin_tile_stream(TileFetch fetch, const void* world)
+{
+	TileStream stream = {};
+	stream.fetch = fetch;
+	stream.world = world;
+	stream.filled = false;
+	return stream;
+}
+
+void stream_tiles(TileStream& stream, Tilemap& ring, int camera_x, int camera_y, int view_width, int view_height)
+{
+	// Keep the visible tiles centred in the window, so there's the same amount
+	// of slack for the camera to move in each direction before streaming.
+	int first_x = floor_divide(camera_x, TILE_DIMENSION);
+	int first_y = floor_divide(camera_y, TILE_DIMENSION);
+	int visible_columns = floor_divide(camera_x + view_width - 1, TILE_DIMENSION) - first_x + 1;
+	int visible_rows = floor_divide(camera_y + view_height - 1, TILE_DIMENSION) - first_y + 1;
+
+	int origin_x = first_x - (ring.columns - visible_columns) / 2;
+	int origin_y = first_y - (ring.rows - visible_rows) / 2;
+
+	int moved_x = origin_x - stream.origin_x;
+	int moved_y = origin_y - stream.origin_y;
+	if(stream.filled && moved_x == 0 && moved_y == 0)
+		return;
+
+	bool jumped = moved_x <= -ring.columns || moved_x >= ring.columns
+		|| moved_y <= -ring.rows || moved_y >= ring.rows;
+
+	if(!stream.filled || jumped)
+	{
+		stream.origin_x = origin_x;
+		stream.origin_y = origin_y;
+		for(int y = origin_y; y < origin_y + ring.rows; ++y)
+		{
+			for(int x = origin_x; x < origin_x + ring.columns; ++x)
+				copy_tile(stream, ring, x, y);
+		}
+		mark_tiles_dirty(ring, 0, 0, ring.columns, ring.rows);
+		stream.filled = true;
+		return;
+	}
+
+	// Columns are brought in over the rows the window had before moving, and
+	// then rows over the new columns, which between them covers the corner
+	// that's new in both directions.
+	int old_origin_x = stream.origin_x;
+	stream.origin_x = origin_x;
+	if(moved_x > 0)
+	{
+		for(int x = old_origin_x + ring.columns; x < origin_x + ring.columns; ++x)
+			stream_column(stream, ring, x);
+	}
+	else
+	{
+		for(int x = origin_x; x < old_origin_x; ++x)
+			stream_column(stream, ring, x);
+	}
+
+	int old_origin_y = stream.origin_y;
+	stream.origin_y = origin_y;
+	if(moved_y > 0)
+	{
+		for(int y = old_origin_y + ring.rows; y < origin_y + ring.rows; ++y)
+			stream_row(stream, ring, y);
+	}
+	else
+	{
+		for(int y = origin_y; y < old_origin_y; ++y)
+			stream_row(stream, ring, y);
+	}
+}
+
+void restream_tiles(TileStream& stream, Tilemap& ring, const TileRect& region)
+{
+	if(!stream.filled) return;
+
+	int left = (region.left > stream.origin_x) ? region.left : stream.origin_x;
+	int top = (region.top > stream.origin_y) ? region.top : stream.origin_y;
+	int right = (region.right < stream.origin_x + ring.columns) ? region.right : stream.origin_x + ring.columns;
+	int bottom = (region.bottom < stream.origin_y + ring.rows) ? region.bottom : stream.origin_y + ring.rows;
+	if(left >= right || top >= bottom) return;
+
+	for(int y = top; y < bottom; ++y)
+	{
+		for(int x = left; x < right; ++x)
+			copy_tile(stream, ring, x, y);
+	}
+
+	// The region can straddle the ring's edges, in which case it's split into
+	// as many as four separate rectangles of the ring.
+	int ring_left = wrap(left, ring.columns);
+	int ring_top = wrap(top, ring.rows);
+	int width = right - left;
+	int height = bottom - top;
+	int first_width = (ring_left + width > ring.columns) ? ring.columns - ring_left : width;
+	int first_height = (ring_top + height > ring.rows) ? ring.rows - ring_top : height;
+
+	mark_tiles_dirty(ring, ring_left, ring_top, first_width, first_height);
+	if(first_width < width)
+		mark_tiles_dirty(ring, 0, ring_top, width - first_width, first_height);
+	if(first_height < height)
+		mark_tiles_dirty(ring, ring_left, 0, first_width, height - first_height);
+	if(first_width < width && first_height < height)
+		mark_tiles_dirty(ring, 0, 0, width - first_width, height - first_height);
+}
+
+void ring_scroll(const Tilemap& ring, int camera_x, int camera_y, byte_t& scroll_x, byte_t& scroll_y)
+{
+	scroll_x = wrap(camera_x, ring.columns * TILE_DIMENSION);
+	scroll_y = wrap(camera_y, ring.rows * TILE_DIMENSION);
+}
@@ -0,0 +1,35 @@
+#ifndef TILE_STREAMING_H
+#define TILE_STREAMING_H
+
+#include "Tilemap.h"
+
+// Shows part of a world map much bigger than the screen through a small
+// tilemap used as a ring buffer, the way the hardware's 32x32 background map
+// is. World tile (x, y) always lives at ring tile (x mod columns, y mod rows),
+// so as the camera moves only the rows and columns coming into view have to be
+// copied in, and the renderer's wraparound does the rest once the scroll
+// registers are set from the camera position.
+
+// Looks up world tile (x, y), which may be outside the world entirely.
+typedef void (*TileFetch)(const void* world, int x, int y, byte_t& tile, byte_t& attribute);
+
+struct TileStream
+{
+	TileFetch fetch;
+	const void* world;
+	int origin_x, origin_y; // world tile at the top-left of the streamed window
+	bool filled;
+};
+
+TileStream begin_tile_stream(const Tilemap* world);
+TileStream begin_tile_stream(TileFetch fetch, const void* world);
+
+// camera position and view size are in pixels
+void stream_tiles(TileStream& stream, Tilemap& ring, int camera_x, int camera_y, int view_width, int view_height);
+
+// Copies in whatever part of a region of the world, in tiles, is currently in
+// the window again. For worlds whose tiles can change or arrive late.
+void restream_tiles(TileStream& stream, Tilemap& ring, const TileRect& region);
+void ring_scroll(const Tilemap& ring, int camera_x, int camera_y, byte_t& scroll_x, byte_t& scroll_y);
+
+#endif
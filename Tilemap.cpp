@@ -3,13 +3,113 @@
 #include "utilities/Logging.h"
 #include "utilities/StringManipulation.h"
 #include "utilities/ArrayMacros.h"
-#include "utilities/Random.h"
+#include "utilities/RunLength.h"
 
-#include <cstdio>
+#include <cstdint>
 
-#define TILE_DIMENSION  8
-#define PATTERN_COUNT_X 32
-#define PATTERN_COUNT_Y 24
+// Tilemap files start with a MapFileHeader, all little-endian. Uncompressed
+// maps follow it directly with the tile plane and then the attribute plane,
+// each one byte per tile in row order, so loading just maps the file and
+// points into it. Compressed maps instead follow the header with a table of
+// MapFileChunk entries, first for the tile plane and then for the attribute
+// plane, each covering chunk_size bytes of its plane (the last one possibly
+// fewer) and stored either raw or run-length encoded.
+
+#define MAP_FILE_MAGIC   0x4D474E4D // "MNGM"
+#define MAP_FILE_VERSION 1
+
+#define MAP_FILE_COMPRESSED 0x0001
+
+#define MAP_CHUNK_RAW        0
+#define MAP_CHUNK_RUN_LENGTH 1
+
+#define DEFAULT_CHUNK_SIZE 4096
+
+struct MapFileHeader
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t flags;
+	uint16_t columns;
+	uint16_t rows;
+	uint32_t chunk_size;
+};
+
+struct MapFileChunk
+{
+	uint32_t offset; // from the start of the file
+	uint32_t stored_size;
+	uint32_t method;
+};
+
+Tilemap create_tilemap(int columns, int rows)
+{
+	size_t tile_count = static_cast<size_t>(columns) * rows;
+
+	Tilemap map = {};
+	map.columns = columns;
+	map.rows = rows;
+	map.tiles = new byte_t[tile_count];
+	map.attributes = new byte_t[tile_count];
+	CLEAR(map.tiles, tile_count);
+	CLEAR(map.attributes, tile_count);
+
+	return map;
+}
+
+static size_t chunk_plane_size(const MapFileHeader& header, int index, size_t plane_size)
+{
+	// every chunk covers chunk_size bytes, except maybe the last
+	size_t start = static_cast<size_t>(index) * header.chunk_size;
+	size_t size = plane_size - start;
+	return (size > header.chunk_size) ? header.chunk_size : size;
+}
+
+// Checks every chunk lies within the file and would expand to exactly the
+// part of the plane it covers, before anything's allocated for the planes.
+static bool check_chunks(const MappedFile& file, const MapFileHeader& header,
+	const MapFileChunk* chunks, int chunk_count, size_t plane_size)
+{
+	for(int i = 0; i < chunk_count; ++i)
+	{
+		const MapFileChunk& chunk = chunks[i];
+		if(static_cast<size_t>(chunk.offset) + chunk.stored_size > file.size)
+			return false;
+
+		size_t expected = chunk_plane_size(header, i, plane_size);
+		const byte_t* stored = static_cast<const byte_t*>(file.data) + chunk.offset;
+		switch(chunk.method)
+		{
+			case MAP_CHUNK_RAW:
+				if(chunk.stored_size != expected) return false;
+				break;
+			case MAP_CHUNK_RUN_LENGTH:
+				if(run_length_decoded_size(stored, chunk.stored_size) != expected) return false;
+				break;
+			default:
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static void decompress_plane(const MappedFile& file, const MapFileHeader& header,
+	const MapFileChunk* chunks, int chunk_count, byte_t* plane, size_t plane_size)
+{
+	for(int i = 0; i < chunk_count; ++i)
+	{
+		const MapFileChunk& chunk = chunks[i];
+		size_t start = static_cast<size_t>(i) * header.chunk_size;
+		size_t size = chunk_plane_size(header, i, plane_size);
+
+		const byte_t* stored = static_cast<const byte_t*>(file.data) + chunk.offset;
+		if(chunk.method == MAP_CHUNK_RAW)
+			COPY(stored, plane + start, size);
+		else
+			run_length_decode(stored, chunk.stored_size, plane + start, size);
+	}
+}
 
 Tilemap load_tilemap(const char* filename)
 {
@@ -19,172 +119,279 @@ Tilemap load_tilemap(const char* filename)
 	char path[128];
 	concatenate("resources/tilemaps/", filename, path);
 
-	// read file data
-	FILE* file = fopen(path, "rb");
-	if(file == nullptr)
+	MappedFile* file = new MappedFile;
+	if(!map_file(file, path))
 	{
 		LOG_ISSUE("couldn't open tilemap file: %s", path);
+		delete file;
+		return map;
+	}
+
+	// check the header
+	MapFileHeader header;
+	if(file->size < sizeof header)
+	{
+		LOG_ISSUE("tilemap file is too small to be a map: %s", path);
+		unmap_file(file);
+		delete file;
+		return map;
+	}
+	COPY(static_cast<const MapFileHeader*>(file->data), &header, 1);
+
+	if(header.magic != MAP_FILE_MAGIC || header.version != MAP_FILE_VERSION)
+	{
+		LOG_ISSUE("tilemap file has an unknown format or version: %s", path);
+		unmap_file(file);
+		delete file;
 		return map;
 	}
 
-	int count_x = 32;
-	int count_y = 32;
-	int tile_count = count_x * count_y;
-	byte_t* tiles = new byte_t[tile_count];
-	byte_t* attributes = new byte_t[tile_count];
+	if(header.columns == 0 || header.rows == 0)
+	{
+		LOG_ISSUE("tilemap file has no tiles: %s", path);
+		unmap_file(file);
+		delete file;
+		return map;
+	}
+
+	size_t plane_size = static_cast<size_t>(header.columns) * header.rows;
+	byte_t* contents = static_cast<byte_t*>(file->data) + sizeof header;
 
-	// TODO: DO IT RIGHT
+	if(!(header.flags & MAP_FILE_COMPRESSED))
 	{
-		random::sow(7);
-		for(int i = 0; i < tile_count; ++i)
+		// The planes are used right where they are in the mapped file, and
+		// pages of it only get read in as they're touched.
+		if(file->size < sizeof header + 2 * plane_size)
 		{
-			tiles[i] = random::reap_integer(0, 255);
-			attributes[i] = random::reap_integer(0, 255);
+			LOG_ISSUE("tilemap file is truncated: %s", path);
+			unmap_file(file);
+			delete file;
+			return map;
 		}
+
+		map.columns = header.columns;
+		map.rows = header.rows;
+		map.tiles = contents;
+		map.attributes = contents + plane_size;
+		map.mapping = file;
+		return map;
 	}
 
-	fclose(file);
+	// Compressed planes have to be expanded into memory of their own, which
+	// is only allocated once the whole file is known to fill it exactly.
+	int chunk_count = 0;
+	if(header.chunk_size > 0 && header.chunk_size <= plane_size)
+		chunk_count = static_cast<int>((plane_size + header.chunk_size - 1) / header.chunk_size);
+
+	size_t table_size = sizeof(MapFileChunk) * 2 * chunk_count;
+	bool loaded = chunk_count > 0 && file->size >= sizeof header + table_size;
+	if(loaded)
+	{
+		MapFileChunk* chunks = new MapFileChunk[2 * chunk_count];
+		COPY(reinterpret_cast<const MapFileChunk*>(contents), chunks, 2 * chunk_count);
+
+		loaded = check_chunks(*file, header, chunks, chunk_count, plane_size)
+			&& check_chunks(*file, header, chunks + chunk_count, chunk_count, plane_size);
+		if(loaded)
+		{
+			map = create_tilemap(header.columns, header.rows);
+			decompress_plane(*file, header, chunks, chunk_count, map.tiles, plane_size);
+			decompress_plane(*file, header, chunks + chunk_count, chunk_count, map.attributes, plane_size);
+		}
+
+		delete[] chunks;
+	}
 
-	map.columns = count_x;
-	map.rows = count_y;
-	map.tiles = tiles;
-	map.attributes = attributes;
+	unmap_file(file);
+	delete file;
+
+	if(!loaded)
+	{
+		LOG_ISSUE("tilemap file has corrupt compressed data: %s", path);
+	}
 
 	return map;
 }
 
 void unload_tilemap(const Tilemap& map)
 {
+	if(map.mapping)
+	{
+		unmap_file(map.mapping);
+		delete map.mapping;
+		return;
+	}
+
 	delete[] map.tiles;
 	delete[] map.attributes;
 }
 
-Mesh create_tilemap_mesh(const Tilemap& map)
+static size_t compress_plane(const byte_t* plane, size_t plane_size, size_t chunk_size,
+	size_t data_offset, MapFileChunk* chunks, byte_t* data)
 {
-	GLuint vertex_array;
-	glGenVertexArrays(1, &vertex_array);
-	glBindVertexArray(vertex_array);
+	size_t written = 0;
+	int chunk_count = static_cast<int>((plane_size + chunk_size - 1) / chunk_size);
+	for(int i = 0; i < chunk_count; ++i)
+	{
+		size_t start = static_cast<size_t>(i) * chunk_size;
+		size_t size = plane_size - start;
+		if(size > chunk_size)
+			size = chunk_size;
 
-	GLuint buffers[2];
-	glGenBuffers(ARRAY_COUNT(buffers), buffers);
+		// keep a chunk raw whenever encoding it wouldn't make it any smaller
+		MapFileChunk& chunk = chunks[i];
+		chunk.offset = static_cast<uint32_t>(data_offset + written);
 
-	GLsizei vertex_components = (2 + 2);
-	GLsizei vertex_width = sizeof(GLfloat) * vertex_components;
+		size_t encoded = run_length_encode(plane + start, size, data + written);
+		if(encoded < size)
+		{
+			chunk.stored_size = static_cast<uint32_t>(encoded);
+			chunk.method = MAP_CHUNK_RUN_LENGTH;
+		}
+		else
+		{
+			COPY(plane + start, data + written, size);
+			chunk.stored_size = static_cast<uint32_t>(size);
+			chunk.method = MAP_CHUNK_RAW;
+		}
+		written += chunk.stored_size;
+	}
 
-	GLsizei tile_count_x = map.columns;
-	GLsizei tile_count_y = map.rows;
-	GLsizei num_vertices = tile_count_x * tile_count_y * 4;
-	GLsizei num_indices = tile_count_x * tile_count_y * 6;
+	return written;
+}
 
-	float texcoord_width =  1.0f / static_cast<float>(PATTERN_COUNT_X);
-	float texcoord_height = 1.0f / static_cast<float>(PATTERN_COUNT_Y);
+void save_tilemap(const Tilemap& map, const char* filename, bool compress)
+{
+	char path[128];
+	concatenate("resources/tilemaps/", filename, path);
 
-	// load tile data into vertices
+	size_t plane_size = static_cast<size_t>(map.columns) * map.rows;
+
+	MapFileHeader header = {};
+	header.magic = MAP_FILE_MAGIC;
+	header.version = MAP_FILE_VERSION;
+	header.flags = compress ? MAP_FILE_COMPRESSED : 0;
+	header.columns = static_cast<uint16_t>(map.columns);
+	header.rows = static_cast<uint16_t>(map.rows);
+	// the loader won't take chunks bigger than the plane they're part of
+	size_t chunk_size = DEFAULT_CHUNK_SIZE;
+	if(plane_size > 0 && plane_size < chunk_size)
+		chunk_size = plane_size;
+	header.chunk_size = compress ? static_cast<uint32_t>(chunk_size) : 0;
+
+	if(!compress)
 	{
-		float* data = new float[vertex_components * num_vertices];
-		for(int y = 0; y < tile_count_y; ++y)
-		{
-			for(int x = 0; x < tile_count_x; ++x)
-			{
-				// Background tiles are numbered from 128 to 383
-				int tile_index = y * tile_count_x + x;
-				int tile_number = 128 + map.tiles[tile_index];
-
-				// The two banks of tile patterns are stored side-by-side in a texture,
-				// so to read from one bank, the total width should be halved.
-				float u = static_cast<float>(tile_number % (PATTERN_COUNT_X / 2)) * texcoord_width;
-				float v = static_cast<float>(tile_number / (PATTERN_COUNT_X / 2)) * texcoord_height;
-				
-				// Tiles in the second bank then need to offset their texture coordinates
-				// by half to read from the correct side.
-				byte_t attribute = map.attributes[tile_index];
-
-				if(attribute & TILE_BANK)
-					u += 0.5f;
-
-				// determine texture coordinates for horizontal/vertical tile flipping
-				float tex_left = u;
-				float tex_right = u + texcoord_width;
-				if(attribute & TILE_HORIZONTAL_FLIP)
-				{
-					tex_left = u + texcoord_width;
-					tex_right = u;
-				}
-				
-				float tex_bottom = v;
-				float tex_top = v + texcoord_height;
-				if(attribute & TILE_VERTICAL_FLIP)
-				{
-					tex_bottom = v + texcoord_height;
-					tex_top = v;
-				}
-
-				// load the positions and texture coordinates to the vertex data array
-				int i = tile_index * 4 * 4;
-
-				float x_offset = x * TILE_DIMENSION;
-				float y_offset = y * TILE_DIMENSION;
-
-				data[i + 0] = x_offset;
-				data[i + 1] = y_offset;
-				data[i + 2] = tex_left;
-				data[i + 3] = tex_bottom;
-
-				data[i + 4] = x_offset + TILE_DIMENSION;
-				data[i + 5] = y_offset;
-				data[i + 6] = tex_right;
-				data[i + 7] = tex_bottom;
-
-				data[i + 8] = x_offset + TILE_DIMENSION;
-				data[i + 9] = y_offset + TILE_DIMENSION;
-				data[i + 10] = tex_right;
-				data[i + 11] = tex_top;
-
-				data[i + 12] = x_offset;
-				data[i + 13] = y_offset + TILE_DIMENSION;
-				data[i + 14] = tex_left;
-				data[i + 15] = tex_top;
-			}
-		}
-
-		glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
-		glBufferData(GL_ARRAY_BUFFER, vertex_width * num_vertices, data, GL_DYNAMIC_DRAW);
+		size_t size = sizeof header + 2 * plane_size;
+		byte_t* data = new byte_t[size];
+		COPY(reinterpret_cast<const byte_t*>(&header), data, sizeof header);
+		COPY(map.tiles, data + sizeof header, plane_size);
+		COPY(map.attributes, data + sizeof header + plane_size, plane_size);
 
+		save_binary_file(data, size, path);
 		delete[] data;
+		return;
 	}
 
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, vertex_width, 0);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, vertex_width, reinterpret_cast<GLvoid*>(sizeof(GLfloat) * 2));
+	int chunk_count = static_cast<int>((plane_size + chunk_size - 1) / chunk_size);
+	size_t table_size = sizeof(MapFileChunk) * 2 * chunk_count;
+	size_t data_offset = sizeof header + table_size;
+
+	MapFileChunk* chunks = new MapFileChunk[2 * chunk_count];
+	byte_t* data = new byte_t[2 * run_length_bound(plane_size) + 2 * chunk_count];
 
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
+	size_t data_size = compress_plane(map.tiles, plane_size, chunk_size, data_offset, chunks, data);
+	data_size += compress_plane(map.attributes, plane_size, chunk_size, data_offset + data_size, chunks + chunk_count, data + data_size);
 
-	// load static indices
+	size_t size = data_offset + data_size;
+	byte_t* file = new byte_t[size];
+	COPY(reinterpret_cast<const byte_t*>(&header), file, sizeof header);
+	COPY(reinterpret_cast<const byte_t*>(chunks), file + sizeof header, table_size);
+	COPY(data, file + data_offset, data_size);
+
+	save_binary_file(file, size, path);
+
+	delete[] file;
+	delete[] data;
+	delete[] chunks;
+}
+
+static inline bool rects_touch(const TileRect& a, const TileRect& b)
+{
+	return a.left <= b.right && b.left <= a.right
+		&& a.top <= b.bottom && b.top <= a.bottom;
+}
+
+static inline TileRect rect_union(const TileRect& a, const TileRect& b)
+{
+	TileRect result;
+	result.left = (a.left < b.left) ? a.left : b.left;
+	result.top = (a.top < b.top) ? a.top : b.top;
+	result.right = (a.right > b.right) ? a.right : b.right;
+	result.bottom = (a.bottom > b.bottom) ? a.bottom : b.bottom;
+	return result;
+}
+
+static inline int rect_area(const TileRect& rect)
+{
+	return (rect.right - rect.left) * (rect.bottom - rect.top);
+}
+
+void mark_tiles_dirty(Tilemap& map, int x, int y, int width, int height)
+{
+	TileRect rect = { x, y, x + width, y + height };
+
+	// fold the change into a rectangle it overlaps or borders, if there is one
+	for(int i = 0; i < map.dirty_rect_count; ++i)
 	{
-		GLushort* indices = new GLushort[num_indices];
-		for(int i = 0; i < tile_count_x * tile_count_y; ++i)
+		if(rects_touch(map.dirty_rects[i], rect))
 		{
-			indices[(i * 6) + 0] = (i * 4) + 0;
-			indices[(i * 6) + 1] = (i * 4) + 3;
-			indices[(i * 6) + 2] = (i * 4) + 1;
-			indices[(i * 6) + 3] = (i * 4) + 1;
-			indices[(i * 6) + 4] = (i * 4) + 3;
-			indices[(i * 6) + 5] = (i * 4) + 2;
+			map.dirty_rects[i] = rect_union(map.dirty_rects[i], rect);
+			return;
 		}
+	}
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * num_indices, indices, GL_STATIC_DRAW);
+	if(map.dirty_rect_count < MAX_DIRTY_RECTS)
+	{
+		map.dirty_rects[map.dirty_rect_count] = rect;
+		map.dirty_rect_count += 1;
+		return;
+	}
 
-		delete[] indices;
+	// all the rectangles are in use, so grow whichever would grow the least
+	int best = 0;
+	int least_growth = -1;
+	for(int i = 0; i < map.dirty_rect_count; ++i)
+	{
+		const TileRect& dirty = map.dirty_rects[i];
+		int growth = rect_area(rect_union(dirty, rect)) - rect_area(dirty);
+		if(least_growth < 0 || growth < least_growth)
+		{
+			best = i;
+			least_growth = growth;
+		}
 	}
-	
-	glBindVertexArray(0);
+	map.dirty_rects[best] = rect_union(map.dirty_rects[best], rect);
+}
+
+void clear_dirty_tiles(Tilemap& map)
+{
+	map.dirty_rect_count = 0;
+}
 
-	Mesh output = {};
-	output.vertex_array = vertex_array;
-	output.buffers[0] = buffers[0];
-	output.buffers[1] = buffers[1];
-	output.num_indices = num_indices;
+void set_tile(Tilemap& map, int x, int y, byte_t tile_number)
+{
+	byte_t& tile = map.tiles[y * map.columns + x];
+	if(tile == tile_number) return;
+
+	tile = tile_number;
+	mark_tiles_dirty(map, x, y, 1, 1);
+}
 
-	return output;
-}
\ No newline at end of file
+void set_tile_attribute(Tilemap& map, int x, int y, byte_t attribute)
+{
+	byte_t& current = map.attributes[y * map.columns + x];
+	if(current == attribute) return;
+
+	current = attribute;
+	mark_tiles_dirty(map, x, y, 1, 1);
+}
@@ -1,9 +1,8 @@
 #ifndef TILEMAP_H
 #define TILEMAP_H
 
-#include "Mesh.h"
-#include "gl_core_3_3.h"
 #include "GameBoyTypes.h"
+#include "utilities/FileHandling.h"
 
 #define TILE_PALETTE         0x07 // least-significant three bits in byte
 #define TILE_BANK            0x08 // bit 3
@@ -12,16 +11,40 @@
 #define TILE_VERTICAL_FLIP   0x40 // bit 6
 #define TILE_BG_PRIORITY     0x80 // bit 7
 
+// Changes made through set_tile/set_tile_attribute are tracked as a few
+// rectangles of tiles, so a renderer only needs to re-send those regions.
+// Once there are more separate changes than rectangles, the closest ones get
+// merged together.
+#define MAX_DIRTY_RECTS 8
+
+struct TileRect
+{
+	int left, top;
+	int right, bottom; // exclusive
+};
+
 struct Tilemap
 {
 	int columns, rows;
 	byte_t* tiles;
 	byte_t* attributes;
+
+	TileRect dirty_rects[MAX_DIRTY_RECTS];
+	int dirty_rect_count;
+
+	// set when the planes point straight into a mapped file instead of the heap
+	MappedFile* mapping;
 };
 
+Tilemap create_tilemap(int columns, int rows);
 Tilemap load_tilemap(const char* filename);
 void unload_tilemap(const Tilemap& map);
+void save_tilemap(const Tilemap& map, const char* filename, bool compress);
+
+void set_tile(Tilemap& map, int x, int y, byte_t tile_number);
+void set_tile_attribute(Tilemap& map, int x, int y, byte_t attribute);
 
-Mesh create_tilemap_mesh(const Tilemap& map);
+void mark_tiles_dirty(Tilemap& map, int x, int y, int width, int height);
+void clear_dirty_tiles(Tilemap& map);
 
 #endif
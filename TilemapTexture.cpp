@@ -0,0 +1,47 @@
+#include "TilemapTexture.h"
+#include "GLState.h"
+
+GLuint create_tilemap_texture(const Tilemap& map)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	bind_texture(GL_TEXTURE_2D_ARRAY, texture);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8UI, map.columns, map.rows, 2, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+
+	buffer_tilemap(map, texture);
+
+	return texture;
+}
+
+void buffer_tilemap(const Tilemap& map, GLuint texture)
+{
+	TileRect whole_map = { 0, 0, map.columns, map.rows };
+	buffer_tilemap_region(map, whole_map, texture);
+}
+
+void buffer_tilemap_region(const Tilemap& map, const TileRect& region, GLuint texture)
+{
+	bind_texture(GL_TEXTURE_2D_ARRAY, texture);
+
+	// Rows of tiles are tightly packed bytes, so they can't be assumed to be
+	// 4-byte aligned like the default unpack alignment expects. The region is
+	// read straight out of the full-width tile planes.
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, map.columns);
+
+	int width = region.right - region.left;
+	int height = region.bottom - region.top;
+	int offset = region.top * map.columns + region.left;
+
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, region.left, region.top, TILEMAP_TILE_LAYER, width, height, 1,
+		GL_RED_INTEGER, GL_UNSIGNED_BYTE, map.tiles + offset);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, region.left, region.top, TILEMAP_ATTRIBUTE_LAYER, width, height, 1,
+		GL_RED_INTEGER, GL_UNSIGNED_BYTE, map.attributes + offset);
+	count_upload(2 * width * height);
+
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
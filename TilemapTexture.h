@@ -0,0 +1,19 @@
+#ifndef TILEMAP_TEXTURE_H
+#define TILEMAP_TEXTURE_H
+
+#include "gl_core_3_3.h"
+#include "Tilemap.h"
+
+// The tilemap is kept on the GPU as a two-layer integer texture with one texel
+// per tile: layer 0 holds tile numbers and layer 1 holds attributes. The
+// background shader resolves those to pattern texels per pixel, so drawing
+// the background only takes a single quad no matter how big the map is.
+
+#define TILEMAP_TILE_LAYER      0
+#define TILEMAP_ATTRIBUTE_LAYER 1
+
+GLuint create_tilemap_texture(const Tilemap& map);
+void buffer_tilemap(const Tilemap& map, GLuint texture);
+void buffer_tilemap_region(const Tilemap& map, const TileRect& region, GLuint texture);
+
+#endif
@@ -0,0 +1,119 @@
+#include "UniformRing.h"
+#include "GLState.h"
+
+#include "utilities/Logging.h"
+
+#include <cassert>
+#include <cstring>
+
+// long enough that a frame which hasn't finished by then never will
+#define FENCE_TIMEOUT 1000000000ull // nanoseconds
+
+static inline GLsizeiptr align_up(GLsizeiptr size, GLint alignment)
+{
+	return (size + alignment - 1) / alignment * alignment;
+}
+
+UniformRing create_uniform_ring(GLsizeiptr frame_size)
+{
+	UniformRing ring = {};
+
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &ring.alignment);
+	if(ring.alignment < 1)
+		ring.alignment = 256;
+
+	ring.frame_size = align_up(frame_size, ring.alignment);
+
+	glGenBuffers(1, &ring.buffer);
+	bind_buffer(GL_UNIFORM_BUFFER, ring.buffer);
+	glBufferData(GL_UNIFORM_BUFFER, UNIFORM_RING_FRAMES * ring.frame_size, nullptr, GL_STREAM_DRAW);
+
+	return ring;
+}
+
+void destroy_uniform_ring(UniformRing& ring)
+{
+	for(int i = 0; i < UNIFORM_RING_FRAMES; ++i)
+	{
+		glDeleteSync(ring.fences[i]);
+		ring.fences[i] = 0;
+	}
+	forget_buffer(ring.buffer);
+	glDeleteBuffers(1, &ring.buffer);
+	ring.buffer = 0;
+}
+
+void begin_uniform_writes(UniformRing& ring)
+{
+	ring.frame = (ring.frame + 1) % UNIFORM_RING_FRAMES;
+
+	// This only ever waits when the GPU is more than the whole ring behind,
+	// which is where a driver would otherwise have stalled anyway.
+	GLsync fence = ring.fences[ring.frame];
+	if(fence != 0)
+	{
+		GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+		if(result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED)
+		{
+			LOG_ISSUE("OpenGL: timed out waiting to reuse uniform ring region %i", ring.frame);
+		}
+		glDeleteSync(fence);
+		ring.fences[ring.frame] = 0;
+	}
+
+	// the fence already covers synchronisation, so the driver needn't
+	bind_buffer(GL_UNIFORM_BUFFER, ring.buffer);
+	GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+	void* mapped = glMapBufferRange(GL_UNIFORM_BUFFER, ring.frame * ring.frame_size, ring.frame_size, access);
+	ring.mapped = static_cast<unsigned char*>(mapped);
+	ring.used = 0;
+
+	// the region is free either way, so blocks can still be copied in by hand
+	if(mapped == nullptr)
+	{
+		LOG_ISSUE("OpenGL: couldn't map uniform ring region %i, so it'll be written without mapping", ring.frame);
+	}
+}
+
+GLintptr push_uniforms(UniformRing& ring, const void* data, GLsizeiptr size)
+{
+	assert(ring.used + size <= ring.frame_size);
+
+	GLintptr offset = ring.used;
+	GLintptr start = ring.frame * ring.frame_size;
+	if(ring.mapped != nullptr)
+	{
+		memcpy(ring.mapped + offset, data, size);
+	}
+	else
+	{
+		bind_buffer(GL_UNIFORM_BUFFER, ring.buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, start + offset, size, data);
+	}
+	count_upload(size);
+	ring.used = align_up(offset + size, ring.alignment);
+
+	return start + offset;
+}
+
+void end_uniform_writes(UniformRing& ring)
+{
+	if(ring.mapped == nullptr) return;
+
+	bind_buffer(GL_UNIFORM_BUFFER, ring.buffer);
+	if(glUnmapBuffer(GL_UNIFORM_BUFFER) == GL_FALSE)
+	{
+		LOG_ISSUE("OpenGL: uniform ring region %i was lost while mapped", ring.frame);
+	}
+	ring.mapped = nullptr;
+}
+
+void bind_uniforms(const UniformRing& ring, GLuint binding, GLintptr offset, GLsizeiptr size)
+{
+	bind_uniform_buffer_range(binding, ring.buffer, offset, size);
+}
+
+void fence_uniform_frame(UniformRing& ring)
+{
+	ring.fences[ring.frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,41 @@
+#ifndef UNIFORM_RING_H
+#define UNIFORM_RING_H
+
+#include "gl_core_3_3.h"
+
+// Per-pass uniform blocks are streamed through one buffer split into a region
+// for each of the last few frames. A frame's blocks are all written into its
+// region at once, then each pass binds its own slice with glBindBufferRange,
+// so no block is ever overwritten while a draw that reads it may be in flight.
+// A fence is placed after each frame's draws, and a region is only reused
+// once the frame that last used it is known to be finished.
+
+#define UNIFORM_RING_FRAMES 3
+
+struct UniformRing
+{
+	GLuint buffer;
+	GLsizeiptr frame_size;
+	GLint alignment;
+
+	GLsync fences[UNIFORM_RING_FRAMES];
+	int frame;
+
+	unsigned char* mapped; // the current frame's region while it's being written, if it could be mapped
+	GLintptr used;
+};
+
+UniformRing create_uniform_ring(GLsizeiptr frame_size);
+void destroy_uniform_ring(UniformRing& ring);
+
+void begin_uniform_writes(UniformRing& ring);
+GLintptr push_uniforms(UniformRing& ring, const void* data, GLsizeiptr size);
+void end_uniform_writes(UniformRing& ring);
+
+// binds a block written by push_uniforms this frame to a uniform buffer binding
+void bind_uniforms(const UniformRing& ring, GLuint binding, GLintptr offset, GLsizeiptr size);
+
+// call after the last draw that uses this frame's blocks
+void fence_uniform_frame(UniformRing& ring);
+
+#endif
@@ -5,6 +5,10 @@
 #include "SoundSystem.h"
 #include "Game.h"
 #include "Input.h"
+#include "SnapshotBuffer.h"
+#include "FixedTimestep.h"
+#include "InputReplay.h"
+#include "RewindBuffer.h"
 
 #include "utilities/Logging.h"
 
@@ -15,6 +19,17 @@
 #include "wgl_extensions.h"
 #include <GL/wglext.h>
 
+#include <mmsystem.h>
+#pragma comment(lib, "winmm.lib")
+
+#include <atomic>
+#include <thread>
+#include <cstdio>
+
+// Sleep can only wake on a tick of the system timer, even at its finest, so
+// the last stretch of each wait is spun out on the performance counter.
+#define SPIN_MARGIN 0.002 // seconds
+
 namespace
 {
 	HWND window = NULL;
@@ -35,10 +50,33 @@ namespace
 	double performance_counter_resolution;
 	double target_seconds_per_frame = 1.0 / 60.0;
 	LARGE_INTEGER last_counter;
+	LARGE_INTEGER next_frame_counter;
+	FixedTimestep timestep;
+
+	InputReplay recording = {};
+	const char* recording_filename = nullptr;
+	InputReplay replay = {};
+	bool replaying = false;
+
+	// Holding backspace steps the game backwards instead of forwards, through
+	// however many steps the rewind buffer has room for.
+	RewindBuffer* rewind_buffer = nullptr;
+	unsigned char* rewind_state = nullptr;
+	bool rewinding = false;
 
 	bool paused = false;
 
 	bool render_system_initialised = false;
+
+	// The game is updated on the main thread and drawn on this one, which
+	// owns the rendering context from when it starts until it stops.
+	std::thread render_thread;
+	std::atomic<bool> rendering;
+	SnapshotBuffer* snapshots = nullptr;
+	HANDLE snapshot_published = NULL;
+
+	// asked for on the main thread, but it's the render thread that acts on it
+	std::atomic<bool> capture_toggled;
 }
 
 static LARGE_INTEGER get_time_counter()
@@ -60,6 +98,85 @@ static void system_error_message(const char* text)
 	windows_error_message(error, text);
 }
 
+static void wait_until(LARGE_INTEGER deadline)
+{
+	for(;;)
+	{
+		double remaining = get_seconds_elapsed(get_time_counter(), deadline);
+		if(remaining <= 0.0)
+			break;
+
+		if(remaining > SPIN_MARGIN)
+			Sleep(static_cast<DWORD>((remaining - SPIN_MARGIN) * 1000.0));
+		else
+			YieldProcessor();
+	}
+}
+
+static void toggle_capture();
+
+static void render_loop()
+{
+	if(wglMakeCurrent(device_context, rendering_context) == FALSE)
+	{
+		system_error_message("couldn't make the rendering context current on the render thread");
+		return;
+	}
+
+	Game::GameState game_state;
+	while(rendering.load())
+	{
+		if(capture_toggled.exchange(false))
+		{
+			toggle_capture();
+		}
+
+		// only draw when the game has moved on; with vertical synchronization
+		// on, it's this thread that waits for the swap and not the game's
+		if(acquire_snapshot(snapshots, game_state))
+		{
+			RenderSystem::Update(game_state);
+			SwapBuffers(device_context);
+		}
+		else
+		{
+			WaitForSingleObject(snapshot_published, 100);
+		}
+	}
+
+	wglMakeCurrent(NULL, NULL);
+}
+
+static bool start_render_thread()
+{
+	snapshots = create_snapshot_buffer();
+	snapshot_published = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if(snapshot_published == NULL)
+	{
+		system_error_message("couldn't create the event for waking the render thread");
+		return false;
+	}
+
+	// a context can only be current on one thread at a time
+	wglMakeCurrent(NULL, NULL);
+
+	rendering = true;
+	render_thread = std::thread(render_loop);
+	return true;
+}
+
+static void stop_render_thread()
+{
+	if(!render_thread.joinable()) return;
+
+	rendering = false;
+	SetEvent(snapshot_published);
+	render_thread.join();
+
+	// take the context back to shut everything down from the main thread
+	wglMakeCurrent(device_context, rendering_context);
+}
+
 bool create_window(HINSTANCE instance)
 {
 	// setup window class
@@ -194,22 +311,66 @@ bool create_window(HINSTANCE instance)
 	// start up the game
 	Game::Initialise();
 
+	// about a quarter of a megabyte holds upwards of twenty seconds of steps
+	{
+		const size_t REWIND_CAPACITY = 256 * 1024;
+		size_t state_size = Game::Saved_State_Size();
+		rewind_buffer = create_rewind_buffer(state_size, REWIND_CAPACITY);
+		rewind_state = new unsigned char[state_size];
+	}
+
 	// start timer
 	{
 		LARGE_INTEGER frequency;
 		QueryPerformanceFrequency(&frequency);
 		performance_counter_resolution = static_cast<double>(frequency.QuadPart);
 
+		// frames are paced to the display, while the game steps at its own rate
+		DEVMODE mode = {};
+		mode.dmSize = sizeof mode;
+		if(EnumDisplaySettings(NULL, ENUM_CURRENT_SETTINGS, &mode) && mode.dmDisplayFrequency > 1)
+		{
+			target_seconds_per_frame = 1.0 / mode.dmDisplayFrequency;
+		}
+		timestep = create_fixed_timestep(GAME_BOY_FRAME_RATE);
+
+		// make Sleep wake up to the millisecond instead of every 15.6ms
+		timeBeginPeriod(1);
+
 		last_counter = get_time_counter();
+		next_frame_counter = last_counter;
 	}
 
-	return true;
+	return start_render_thread();
 }
 
 void destroy_window()
 {
+	stop_render_thread();
+	destroy_snapshot_buffer(snapshots);
+	snapshots = nullptr;
+	if(snapshot_published != NULL)
+	{
+		CloseHandle(snapshot_published);
+		snapshot_published = NULL;
+	}
+
+	destroy_rewind_buffer(rewind_buffer);
+	rewind_buffer = nullptr;
+	delete[] rewind_state;
+	rewind_state = nullptr;
+
 	Game::Terminate();
 
+	if(recording_filename != nullptr)
+	{
+		save_input_replay(recording, recording_filename);
+		destroy_input_replay(recording);
+	}
+	destroy_input_replay(replay);
+
+	timeEndPeriod(1);
+
 	SoundSystem::Stop();
 	SoundSystem::Terminate();
 
@@ -268,27 +429,77 @@ int message_loop()
 		double delta_time = get_seconds_elapsed(last_counter, now);
 		last_counter = now;
 
-		Game::GameState game_state = Game::Update(input_state, delta_time);
-		RenderSystem::Update(game_state);
+		// step the game however many times fit in the time that's passed, then
+		// draw it however far it's got towards the next step
+		int steps = advance_timestep(timestep, delta_time);
+
+		// a replay decides how many steps each frame takes, not the clock
+		byte_t frame_input = input_state;
+		if(replaying)
+		{
+			replaying = play_input(replay, &frame_input, &steps);
+			if(!replaying)
+			{
+				frame_input = input_state;
+			}
+		}
+		if(recording_filename != nullptr)
+		{
+			record_input(recording, frame_input, steps);
+		}
 
-		if(!vertical_synchronization)
+		// Rewinding would throw a recording or replay out of step with the
+		// game, so it's only allowed when neither is going.
+		bool can_rewind = !replaying && recording_filename == nullptr;
+		for(int i = 0; i < steps; ++i)
 		{
-			// sleep away the rest of the frame
-			LARGE_INTEGER now = get_time_counter();
-			double frame_time_thusfar = get_seconds_elapsed(last_counter, now);
-			if(frame_time_thusfar < target_seconds_per_frame)
+			if(rewinding && can_rewind)
 			{
-				DWORD time_to_sleep = (target_seconds_per_frame - frame_time_thusfar) * 1000.0;
-				Sleep(time_to_sleep);
+				// the states before a corrupt one can't be reached from here
+				if(pop_rewind_state(rewind_buffer, rewind_state) && !Game::Load_State(rewind_state))
+				{
+					clear_rewind_buffer(rewind_buffer);
+					rewinding = false;
+				}
+				continue;
 			}
+
+			Game::Update(frame_input);
+			Game::Save_State(rewind_state);
+			push_rewind_state(rewind_buffer, rewind_state);
 		}
 
-		SwapBuffers(device_context);
+		Game::GameState game_state = Game::Get_State(timestep_interpolation(timestep));
+		publish_snapshot(snapshots, game_state);
+		SetEvent(snapshot_published);
+
+		// The render thread waits on vertical synchronization by itself, so
+		// this thread always has to keep its own time. Each frame is due a
+		// fixed period after the last was due, rather than after it finished,
+		// so that lateness doesn't pile up; after a long hitch it starts over.
+		{
+			LONGLONG period = static_cast<LONGLONG>(target_seconds_per_frame * performance_counter_resolution);
+			next_frame_counter.QuadPart += period;
+			if(next_frame_counter.QuadPart < now.QuadPart)
+				next_frame_counter = now;
+			wait_until(next_frame_counter);
+		}
 	}
 
 	return msg.wParam;
 }
 
+void record_input_to(const char* filename)
+{
+	recording_filename = filename;
+}
+
+bool replay_input_from(const char* filename)
+{
+	replaying = load_input_replay(replay, filename);
+	return replaying;
+}
+
 #define MESSAGE_BOX_MAX_CHARS 1024
 
 void show_error_message()
@@ -310,6 +521,9 @@ void show_error_message()
 
 static LRESULT on_close(HWND hwnd)
 {
+	// the render thread draws through the device context about to be released
+	stop_render_thread();
+
 	if(ReleaseDC(window, device_context) == 0)
 	{
 		LOG_ISSUE("failed to release device context on shutdown");
@@ -359,14 +573,49 @@ static inline byte_t get_key_mask(USHORT key)
 	return 0x00;
 }
 
-static LRESULT on_key_down(USHORT key)
+static void toggle_capture()
 {
+	if(RenderSystem::Is_Capturing())
+	{
+		RenderSystem::Stop_Capture();
+		return;
+	}
+
+	// name each capture after when it was started, so none get overwritten
+	SYSTEMTIME time;
+	GetLocalTime(&time);
+	char filename[64];
+	snprintf(filename, sizeof filename, "capture-%04i%02i%02i-%02i%02i%02i.mngc",
+		time.wYear, time.wMonth, time.wDay, time.wHour, time.wMinute, time.wSecond);
+	RenderSystem::Start_Capture(filename);
+}
+
+static LRESULT on_key_down(USHORT key, bool repeat)
+{
+	if(key == VK_F9)
+	{
+		if(!repeat)
+			capture_toggled = true;
+		return 0;
+	}
+	if(key == VK_BACK)
+	{
+		rewinding = true;
+		return 0;
+	}
+
 	input_state |= get_key_mask(key);
 	return 0;
 }
 
 static LRESULT on_key_up(USHORT key)
 {
+	if(key == VK_BACK)
+	{
+		rewinding = false;
+		return 0;
+	}
+
 	input_state &= ~get_key_mask(key);
 	return 0;
 }
@@ -381,7 +630,7 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT message, WPARAM w_param, LPARAM l_pa
 			break;
 
 		case WM_ACTIVATE: return on_activate(LOWORD(w_param));
-		case WM_KEYDOWN: return on_key_down(w_param);
+		case WM_KEYDOWN: return on_key_down(w_param, (l_param & (1 << 30)) != 0);
 		case WM_KEYUP: return on_key_up(w_param);
 	}
 	return DefWindowProc(hwnd, message, w_param, l_param);
@@ -14,6 +14,12 @@ void show_window(int show_mode);
 int message_loop();
 void show_error_message();
 
+// Either records every frame's input from the start, to be saved once the
+// window is destroyed, or plays back a recording in place of the keyboard
+// until it runs out. Set these up before the message loop starts.
+void record_input_to(const char* filename);
+bool replay_input_from(const char* filename);
+
 LRESULT CALLBACK WindowProc(HWND hWnd, UINT uiMsg, WPARAM wParam, LPARAM lParam);
 
 #define WINDOWS_PLATFORM_H
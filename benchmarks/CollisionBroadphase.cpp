@@ -0,0 +1,168 @@
+// Measures the collision module with 1K, 10K and 100K entities drifting about
+// the 256x256 pixel world: keeping the grid up to date, finding what every
+// entity overlaps, and sweeping every entity against a map's solid tiles. For
+// the smaller counts, overlaps are also found by checking every pair against
+// every other, both to compare against and to check the grid finds the same.
+//
+// usage: CollisionBroadphase [frames]
+
+#include "Collision.h"
+#include "EntityPool.h"
+#include "Tilemap.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#define MAP_SIZE         32 // tiles, which is the whole 256 pixel world
+#define DEFAULT_FRAMES   100
+#define MAX_BRUTE_FORCE  10000
+#define HITS_PER_BATCH   65536
+
+typedef std::chrono::steady_clock Clock;
+
+static double milliseconds_between(Clock::time_point start, Clock::time_point end)
+{
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+static long long find_all_overlaps(const CollisionGrid& grid, const EntityPool& pool, std::vector<OverlapQuery>& queries, std::vector<CollisionHit>& hits)
+{
+	for(int i = 0; i < pool.count; ++i)
+	{
+		OverlapQuery& query = queries[i];
+		query.x = pool.position_x[i] >> 8;
+		query.y = pool.position_y[i] >> 8;
+		query.width = ENTITY_SIZE;
+		query.height = ENTITY_SIZE;
+		query.ignore = i;
+	}
+
+	// answer them a batch of hits at a time, as a game would between handling
+	long long total = 0;
+	for(int done = 0; done < pool.count; )
+	{
+		int hit_count;
+		done += find_overlaps(grid, &queries[done], pool.count - done, hits.data(), hits.size(), &hit_count);
+		total += hit_count;
+	}
+	return total;
+}
+
+static long long brute_force_overlaps(const EntityPool& pool)
+{
+	long long total = 0;
+	for(int i = 0; i < pool.count; ++i)
+	{
+		int x = pool.position_x[i] >> 8;
+		int y = pool.position_y[i] >> 8;
+		for(int j = 0; j < pool.count; ++j)
+		{
+			int dx = ((pool.position_x[j] >> 8) - x + ENTITY_SIZE - 1) & 0xFF;
+			int dy = ((pool.position_y[j] >> 8) - y + ENTITY_SIZE - 1) & 0xFF;
+			if(j != i && dx < 2 * ENTITY_SIZE - 1 && dy < 2 * ENTITY_SIZE - 1)
+				total += 1;
+		}
+	}
+	return total;
+}
+
+static void sweep_all(const TileSolidity& solidity, const EntityPool& pool, std::vector<SweepQuery>& queries, std::vector<SweepResult>& results)
+{
+	for(int i = 0; i < pool.count; ++i)
+	{
+		SweepQuery& query = queries[i];
+		query.x = pool.position_x[i] >> 8;
+		query.y = pool.position_y[i] >> 8;
+		query.move_x = pool.velocity_x[i] / 0x100;
+		query.move_y = pool.velocity_y[i] / 0x100;
+	}
+	sweep_against_tiles(solidity, queries.data(), results.data(), pool.count);
+}
+
+int main(int argc, char** argv)
+{
+	int frames = (argc > 1) ? atoi(argv[1]) : DEFAULT_FRAMES;
+	if(frames < 1) frames = 1;
+
+	srand(7);
+
+	// about one tile in eight is a wall
+	Tilemap map = create_tilemap(MAP_SIZE, MAP_SIZE);
+	for(int y = 0; y < MAP_SIZE; ++y)
+	{
+		for(int x = 0; x < MAP_SIZE; ++x)
+		{
+			byte_t attribute = (rand() % 8 == 0) ? TILE_BG_PRIORITY : 0;
+			set_tile_attribute(map, x, y, attribute);
+		}
+	}
+	TileSolidity solidity = create_tile_solidity(map, TILE_BG_PRIORITY);
+
+	printf("entities    grid ms  overlaps ms  hits/frame    sweep ms  all pairs ms\n");
+
+	const int entity_counts[] = { 1000, 10000, 100000 };
+	for(int count : entity_counts)
+	{
+		EntityPool pool = create_entity_pool(count);
+		for(int i = 0; i < count; ++i)
+		{
+			int entity = spawn_entity(pool, rand(), rand(), 0, 0);
+			pool.velocity_x[entity] = rand() % 0x400 - 0x200;
+			pool.velocity_y[entity] = rand() % 0x400 - 0x200;
+		}
+
+		CollisionGrid grid = create_collision_grid(count);
+		update_collision_grid(grid, pool);
+
+		std::vector<OverlapQuery> overlap_queries(count);
+		std::vector<CollisionHit> hits(HITS_PER_BATCH);
+		std::vector<SweepQuery> sweep_queries(count);
+		std::vector<SweepResult> sweep_results(count);
+
+		double grid_time = 0.0, overlap_time = 0.0, sweep_time = 0.0;
+		long long hit_total = 0;
+		for(int frame = 0; frame < frames; ++frame)
+		{
+			move_entities(pool, 0, 0);
+
+			Clock::time_point start = Clock::now();
+			update_collision_grid(grid, pool);
+			Clock::time_point updated = Clock::now();
+			hit_total += find_all_overlaps(grid, pool, overlap_queries, hits);
+			Clock::time_point overlapped = Clock::now();
+			sweep_all(solidity, pool, sweep_queries, sweep_results);
+			Clock::time_point swept = Clock::now();
+
+			grid_time += milliseconds_between(start, updated);
+			overlap_time += milliseconds_between(updated, overlapped);
+			sweep_time += milliseconds_between(overlapped, swept);
+		}
+
+		printf("%8d %10.4f %12.4f %11lld %11.4f", count,
+			grid_time / frames, overlap_time / frames, hit_total / frames, sweep_time / frames);
+
+		// one frame is plenty for this, and for the largest count it's too slow
+		if(count <= MAX_BRUTE_FORCE)
+		{
+			Clock::time_point start = Clock::now();
+			long long brute_hits = brute_force_overlaps(pool);
+			Clock::time_point end = Clock::now();
+			long long grid_hits = find_all_overlaps(grid, pool, overlap_queries, hits);
+
+			printf(" %13.4f", milliseconds_between(start, end));
+			if(brute_hits != grid_hits)
+				printf("  (grid found %lld hits, all pairs %lld)", grid_hits, brute_hits);
+		}
+		printf("\n");
+
+		destroy_collision_grid(grid);
+		destroy_entity_pool(pool);
+	}
+
+	destroy_tile_solidity(solidity);
+	unload_tilemap(map);
+
+	return 0;
+}
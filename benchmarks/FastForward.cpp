@@ -0,0 +1,174 @@
+// Runs the game as fast as it will go with no window, no GPU and no frame
+// pacing, and reports how quickly it steps and renders. Input comes from an
+// input replay, played back frame by frame with the same number of steps each
+// frame as when it was recorded, or else is left at nothing pressed with one
+// step a frame, so every run of the same input is the same. Run it from the
+// repository root so the map and tile atlas can be found.
+//
+// usage: FastForward [--frames N] [--replay FILE] [--render none|software]
+//                    [--threads N]
+
+#include "SoftwareRenderSystem.h"
+#include "Game.h"
+#include "InputReplay.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#define FRAME_WIDTH    160
+#define FRAME_HEIGHT   144
+#define DEFAULT_FRAMES 10000
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_between(Clock::time_point start, Clock::time_point end)
+{
+	return std::chrono::duration<double>(end - start).count();
+}
+
+static double percentile(const std::vector<double>& sorted, double fraction)
+{
+	// nearest rank
+	size_t rank = static_cast<size_t>(fraction * sorted.size() + 0.5);
+	if(rank < 1) rank = 1;
+	if(rank > sorted.size()) rank = sorted.size();
+	return sorted[rank - 1];
+}
+
+static void report(const char* name, std::vector<double>& times)
+{
+	if(times.empty()) return;
+
+	double total = 0.0;
+	for(size_t i = 0; i < times.size(); ++i)
+		total += times[i];
+	std::sort(times.begin(), times.end());
+
+	// percentiles of time per frame, so the slow frames are the high ones
+	printf("%-8s %12.0f %10.4f %10.4f %10.4f %10.4f\n", name,
+		times.size() / total,
+		1000.0 * percentile(times, 0.50),
+		1000.0 * percentile(times, 0.90),
+		1000.0 * percentile(times, 0.99),
+		1000.0 * times.back());
+}
+
+static void print_usage()
+{
+	fprintf(stderr, "usage: FastForward [--frames N] [--replay FILE] [--render none|software] [--threads N]\n");
+}
+
+int main(int argc, char** argv)
+{
+	int frame_count = 0;
+	const char* replay_file = nullptr;
+	bool render = true;
+	int threads = 1;
+
+	for(int i = 1; i < argc; ++i)
+	{
+		bool has_value = i + 1 < argc;
+		if(strcmp(argv[i], "--frames") == 0 && has_value)
+		{
+			frame_count = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--replay") == 0 && has_value)
+		{
+			replay_file = argv[++i];
+		}
+		else if(strcmp(argv[i], "--render") == 0 && has_value)
+		{
+			const char* mode = argv[++i];
+			if(strcmp(mode, "none") == 0)
+				render = false;
+			else if(strcmp(mode, "software") == 0)
+				render = true;
+			else
+			{
+				print_usage();
+				return 1;
+			}
+		}
+		else if(strcmp(argv[i], "--threads") == 0 && has_value)
+		{
+			threads = atoi(argv[++i]);
+		}
+		else
+		{
+			print_usage();
+			return 1;
+		}
+	}
+
+	// a replay runs to its end unless told to stop sooner
+	InputReplay replay = {};
+	if(replay_file != nullptr)
+	{
+		if(!load_input_replay(replay, replay_file))
+		{
+			fprintf(stderr, "couldn't load input replay %s\n", replay_file);
+			return 1;
+		}
+		if(frame_count < 1 || frame_count > replay.frame_count)
+			frame_count = replay.frame_count;
+	}
+	if(frame_count < 1) frame_count = DEFAULT_FRAMES;
+
+	if(render)
+	{
+		if(!SoftwareRenderSystem::Initialise(FRAME_WIDTH, FRAME_HEIGHT, 1))
+		{
+			fprintf(stderr, "software renderer failed to initialise\n");
+			return 1;
+		}
+		SoftwareRenderSystem::Set_Thread_Count(threads);
+	}
+	Game::Initialise();
+
+	std::vector<double> step_times;
+	std::vector<double> render_times;
+	step_times.reserve(frame_count);
+	if(render)
+		render_times.reserve(frame_count);
+
+	Clock::time_point start = Clock::now();
+	for(int frame = 0; frame < frame_count; ++frame)
+	{
+		byte_t input_state = 0;
+		int steps = 1;
+		if(replay_file != nullptr)
+			play_input(replay, &input_state, &steps);
+
+		Clock::time_point step_start = Clock::now();
+		for(int i = 0; i < steps; ++i)
+		{
+			Game::Update(input_state);
+		}
+		Game::GameState game = Game::Get_State(0.0);
+		Clock::time_point step_end = Clock::now();
+		step_times.push_back(seconds_between(step_start, step_end));
+
+		if(render)
+		{
+			SoftwareRenderSystem::Update(game);
+			render_times.push_back(seconds_between(step_end, Clock::now()));
+		}
+	}
+	double total = seconds_between(start, Clock::now());
+
+	printf("%d frames in %.3f s, %.0f frames/s overall\n\n", frame_count, total, frame_count / total);
+	printf("phase        frames/s    p50 ms     p90 ms     p99 ms     max ms\n");
+	report("step", step_times);
+	report("render", render_times);
+
+	Game::Terminate();
+	if(render)
+		SoftwareRenderSystem::Terminate();
+	destroy_input_replay(replay);
+
+	return 0;
+}
@@ -0,0 +1,69 @@
+// Measures how software rendering throughput scales with the number of
+// threads, from one thread up to the number of processors (or the count given
+// as the first argument). Run it from the repository root so the map and tile
+// atlas resources can be found.
+
+#include "SoftwareRenderSystem.h"
+#include "Game.h"
+
+#include "utilities/WorkerPool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#define FRAME_WIDTH   160
+#define FRAME_HEIGHT  144
+#define WARMUP_FRAMES 200
+#define TIMED_FRAMES  5000
+
+static double render_frames(int frame_count)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	Clock::time_point start = Clock::now();
+	for(int i = 0; i < frame_count; ++i)
+	{
+		Game::Update(0);
+		Game::GameState game = Game::Get_State(0.0);
+		SoftwareRenderSystem::Update(game);
+	}
+	Clock::time_point end = Clock::now();
+
+	return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char** argv)
+{
+	int max_threads = (argc > 1) ? atoi(argv[1]) : processor_count();
+	if(max_threads < 1) max_threads = 1;
+
+	if(!SoftwareRenderSystem::Initialise(FRAME_WIDTH, FRAME_HEIGHT, 1))
+	{
+		fprintf(stderr, "software renderer failed to initialise\n");
+		return 1;
+	}
+	Game::Initialise();
+
+	printf("threads   frames/s   ms/frame   speedup\n");
+
+	double single_thread_rate = 0.0;
+	for(int threads = 1; threads <= max_threads; ++threads)
+	{
+		SoftwareRenderSystem::Set_Thread_Count(threads);
+
+		render_frames(WARMUP_FRAMES);
+		double seconds = render_frames(TIMED_FRAMES);
+
+		double rate = TIMED_FRAMES / seconds;
+		if(threads == 1)
+			single_thread_rate = rate;
+
+		printf("%7d %10.0f %10.4f %8.2fx\n", threads, rate, 1000.0 / rate, rate / single_thread_rate);
+	}
+
+	Game::Terminate();
+	SoftwareRenderSystem::Terminate();
+
+	return 0;
+}
@@ -0,0 +1,75 @@
+#version 330
+
+#define TILE_DIMENSION    8
+#define PATTERNS_PER_BANK 384
+
+#define TILE_PALETTE         0x07u
+#define TILE_BANK            0x08u
+#define TILE_HORIZONTAL_FLIP 0x20u
+#define TILE_VERTICAL_FLIP   0x40u
+
+// Palette RAM as RGB555 colours packed two to a uint: background palettes
+// 0-7 take the first four vectors and object palettes the last four.
+layout(std140) uniform PaletteBlock
+{
+    uvec4 palette_words[8];
+};
+
+// per-pass values, shared with the vertex shader
+layout(std140) uniform ObjectBlock
+{
+    mat4 model_view_projection;
+    ivec2 scroll;
+    int palette_base;
+    int tileset;
+    int background_tileset; // for sprites to see the background under them
+};
+
+uniform usampler2DArray patterns;
+uniform usampler2DArray tilemap;
+
+layout(location = 0) out vec4 outputColor;
+
+uint pattern_color(int pattern, ivec2 fine)
+{
+    // each row of a pattern is a byte of low bits followed by one of high bits
+    uint low = texelFetch(patterns, ivec3(2 * fine.y, pattern, tileset), 0).r;
+    uint high = texelFetch(patterns, ivec3(2 * fine.y + 1, pattern, tileset), 0).r;
+    int bit = 7 - fine.x;
+    return ((low >> bit) & 1u) | (((high >> bit) & 1u) << 1);
+}
+
+vec4 palette_color(uint palette, uint color)
+{
+    uint entry = 4u * palette + color;
+    uint pair = palette_words[entry / 8u][(entry / 2u) % 4u];
+    uint rgb = pair >> (16u * (entry % 2u));
+    return vec4(uvec3(rgb, rgb >> 5, rgb >> 10) & 31u, 31u) / 31.0;
+}
+
+void main()
+{
+    // Pixels of the background line up one-to-one with the target, so the
+    // fragment position and scroll are all that's needed to find which tile
+    // it is in. The map wraps around at its edges.
+    ivec2 map_size = textureSize(tilemap, 0).xy * TILE_DIMENSION;
+    ivec2 pixel = (ivec2(gl_FragCoord.xy) + scroll) % map_size;
+    ivec2 tile = pixel / TILE_DIMENSION;
+
+    uint tile_index = texelFetch(tilemap, ivec3(tile, 0), 0).r;
+    uint attribute = texelFetch(tilemap, ivec3(tile, 1), 0).r;
+
+    ivec2 fine = pixel % TILE_DIMENSION;
+    if((attribute & TILE_HORIZONTAL_FLIP) != 0u)
+        fine.x = TILE_DIMENSION - 1 - fine.x;
+    if((attribute & TILE_VERTICAL_FLIP) != 0u)
+        fine.y = TILE_DIMENSION - 1 - fine.y;
+
+    // Background tiles are numbered from 128 to 383.
+    int pattern = 128 + int(tile_index);
+    if((attribute & TILE_BANK) != 0u)
+        pattern += PATTERNS_PER_BANK;
+
+    uint color = pattern_color(pattern, fine);
+    outputColor = palette_color(uint(palette_base) + (attribute & TILE_PALETTE), color);
+}
@@ -3,6 +3,10 @@
 layout(std140) uniform ObjectBlock
 {
 	mat4 model_view_projection;
+	ivec2 scroll;
+	int palette_base;
+	int tileset;
+	int background_tileset; // for sprites to see the background under them
 };
 
 layout(location = 0) in vec2 position;
@@ -0,0 +1,99 @@
+#version 330
+
+#define TILE_DIMENSION    8
+#define PATTERNS_PER_BANK 384
+
+#define TILE_BANK            0x08u
+#define TILE_HORIZONTAL_FLIP 0x20u
+#define TILE_VERTICAL_FLIP   0x40u
+#define TILE_BG_PRIORITY     0x80u
+
+// Palette RAM as RGB555 colours packed two to a uint: background palettes
+// 0-7 take the first four vectors and object palettes the last four.
+layout(std140) uniform PaletteBlock
+{
+	uvec4 palette_words[8];
+};
+
+// per-pass values, shared with the vertex shader
+layout(std140) uniform ObjectBlock
+{
+	mat4 model_view_projection;
+	ivec2 scroll;
+	int palette_base;
+	int tileset;
+	int background_tileset; // for sprites to see the background under them
+};
+
+uniform usampler2DArray patterns;
+uniform usampler2DArray tilemap;
+
+flat in int pattern;
+flat in uint palette;
+flat in uint rows;
+flat in int top;
+flat in int behind;
+in vec2 fine;
+
+layout(location = 0) out vec4 outputColor;
+
+uint pattern_color(int pattern, ivec2 fine, int layer)
+{
+	// each row of a pattern is a byte of low bits followed by one of high bits
+	uint low = texelFetch(patterns, ivec3(2 * fine.y, pattern, layer), 0).r;
+	uint high = texelFetch(patterns, ivec3(2 * fine.y + 1, pattern, layer), 0).r;
+	int bit = 7 - fine.x;
+	return ((low >> bit) & 1u) | (((high >> bit) & 1u) << 1);
+}
+
+vec4 palette_color(uint palette, uint color)
+{
+	uint entry = 4u * palette + color;
+	uint pair = palette_words[entry / 8u][(entry / 2u) % 4u];
+	uint rgb = pair >> (16u * (entry % 2u));
+	return vec4(uvec3(rgb, rgb >> 5, rgb >> 10) & 31u, 31u) / 31.0;
+}
+
+// Whether the background pixel here is drawn over sprites, which it is when
+// it's colour 1-3 and either its tile or the sprite asks to be behind.
+bool background_covers(ivec2 screen)
+{
+	ivec2 map_size = textureSize(tilemap, 0).xy * TILE_DIMENSION;
+	ivec2 pixel = (screen + scroll) % map_size;
+	ivec2 tile = pixel / TILE_DIMENSION;
+
+	uint tile_index = texelFetch(tilemap, ivec3(tile, 0), 0).r;
+	uint attribute = texelFetch(tilemap, ivec3(tile, 1), 0).r;
+	if(behind == 0 && (attribute & TILE_BG_PRIORITY) == 0u)
+		return false;
+
+	ivec2 fine = pixel % TILE_DIMENSION;
+	if((attribute & TILE_HORIZONTAL_FLIP) != 0u)
+		fine.x = TILE_DIMENSION - 1 - fine.x;
+	if((attribute & TILE_VERTICAL_FLIP) != 0u)
+		fine.y = TILE_DIMENSION - 1 - fine.y;
+
+	int tile_pattern = 128 + int(tile_index);
+	if((attribute & TILE_BANK) != 0u)
+		tile_pattern += PATTERNS_PER_BANK;
+
+	return pattern_color(tile_pattern, fine, background_tileset) != 0u;
+}
+
+void main()
+{
+	// rows the OAM scan dropped from their line aren't drawn
+	ivec2 screen = ivec2(gl_FragCoord.xy);
+	if(((rows >> uint(screen.y - top)) & 1u) == 0u)
+		discard;
+
+	// colour 0 is always transparent for sprites
+	uint color = pattern_color(pattern, clamp(ivec2(fine), 0, 7), tileset);
+	if(color == 0u)
+		discard;
+
+	if(background_covers(screen))
+		discard;
+
+	outputColor = palette_color(palette, color);
+}
@@ -0,0 +1,67 @@
+#version 330
+
+#define SPRITE_WIDTH      8
+#define SPRITE_HEIGHT     8
+#define PATTERNS_PER_BANK 384
+
+#define SPRITE_PALETTE         0x07u
+#define SPRITE_BANK            0x08u
+#define SPRITE_HORIZONTAL_FLIP 0x20u
+#define SPRITE_VERTICAL_FLIP   0x40u
+#define SPRITE_BG_PRIORITY     0x80u
+
+layout(std140) uniform ObjectBlock
+{
+	mat4 model_view_projection;
+	ivec2 scroll;
+	int palette_base;
+	int tileset;
+	int background_tileset; // for sprites to see the background under them
+};
+
+// position_x, position_y, tile_number, attribute
+layout(location = 0) in uvec4 sprite;
+
+// which of the sprite's rows the OAM scan let through, top row in bit 0
+layout(location = 1) in uint visible_rows;
+
+flat out int pattern;
+flat out uint palette;
+flat out uint rows;
+flat out int top;
+flat out int behind;
+out vec2 fine;
+
+void main(void)
+{
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+
+	// Sprite tiles are numbered from 0 to 255, and the second bank's patterns
+	// follow on after all of the first bank's.
+	uint tile_number = sprite.z;
+	uint attribute = sprite.w;
+
+	pattern = int(tile_number);
+	if((attribute & SPRITE_BANK) != 0u)
+		pattern += PATTERNS_PER_BANK;
+
+	palette = uint(palette_base) + (attribute & SPRITE_PALETTE);
+	rows = visible_rows;
+	top = int(sprite.y);
+	behind = int((attribute & SPRITE_BG_PRIORITY) != 0u);
+
+	vec2 flipped = corner;
+	if((attribute & SPRITE_HORIZONTAL_FLIP) != 0u)
+		flipped.x = 1.0 - flipped.x;
+	if((attribute & SPRITE_VERTICAL_FLIP) != 0u)
+		flipped.y = 1.0 - flipped.y;
+
+	fine = flipped * vec2(SPRITE_WIDTH, SPRITE_HEIGHT);
+
+	vec2 position = vec2(sprite.xy) + corner * vec2(SPRITE_WIDTH, SPRITE_HEIGHT);
+	gl_Position = model_view_projection * vec4(position, 0, 1);
+
+	// a sprite that was dropped from every line gets clipped away whole
+	if(visible_rows == 0u)
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+}
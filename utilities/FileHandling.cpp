@@ -12,6 +12,7 @@
 #elif defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 
 #include <fcntl.h>
 #include <unistd.h>
@@ -185,11 +186,16 @@ void close_file_stream(void* stream)
 	CloseHandle(stream);
 }
 
+bool is_file_stream_open(file_handle_t file)
+{
+	return file != INVALID_HANDLE_VALUE;
+}
+
 size_t read_file_stream(void* fileHandle, unsigned long long readOffset, void* buffer, size_t size)
 {
 	OVERLAPPED overlap = {};
 	overlap.Offset = readOffset & 0xFFFFFFFF;
-	overlap.OffsetHigh = readOffset >> 8;
+	overlap.OffsetHigh = readOffset >> 32;
 
 	DWORD numBytesRead;
 	BOOL fileRead = ReadFile(fileHandle, buffer, size, &numBytesRead, &overlap);
@@ -201,12 +207,71 @@ size_t read_file_stream(void* fileHandle, unsigned long long readOffset, void* b
 	return numBytesRead;
 }
 
+unsigned long long file_stream_size(file_handle_t file)
+{
+	LARGE_INTEGER size;
+	if(GetFileSizeEx(file, &size) == FALSE)
+	{
+		LOG_ISSUE("could not get the size of a file stream.");
+		return 0;
+	}
+	return size.QuadPart;
+}
+
+bool map_file(MappedFile* file, const char* filePath)
+{
+	HANDLE handle = open_file(filePath, FILE_MODE_READ);
+	if(handle == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if(GetFileSizeEx(handle, &size) == FALSE || size.QuadPart == 0)
+	{
+		LOG_ISSUE("could not map empty or unreadable file: %s", filePath);
+
+		CloseHandle(handle);
+		return false;
+	}
+
+	// the mapping object keeps the file open, so the handle can go right away
+	HANDLE mapping = CreateFileMappingW(handle, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	CloseHandle(handle);
+	if(mapping == NULL)
+	{
+		LOG_ISSUE("could not create file mapping for file: %s", filePath);
+		return false;
+	}
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	if(view == NULL)
+	{
+		LOG_ISSUE("could not map view of file: %s", filePath);
+
+		CloseHandle(mapping);
+		return false;
+	}
+
+	file->data = view;
+	file->size = static_cast<size_t>(size.QuadPart);
+	file->mapping = mapping;
+	return true;
+}
+
+void unmap_file(MappedFile* file)
+{
+	UnmapViewOfFile(file->data);
+	CloseHandle(file->mapping);
+
+	file->data = nullptr;
+	file->size = 0;
+	file->mapping = nullptr;
+}
+
 #elif defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
 
 static int open_file(const char* filePath, FileWriteMode openMode)
 {
 	int flags;
-	mode_t mode;
+	mode_t mode = 0;
 	switch(openMode)
 	{
 		case FILE_MODE_OVERWRITE:
@@ -236,8 +301,8 @@ static int open_file(const char* filePath, FileWriteMode openMode)
 	int file = open(filePath, flags, mode);
 	if(file < 0)
 	{
-		Log::Add(Log::ISSUE, "Error opening file %s - %s", filePath, strerror(errno));
-		return 0;
+		LOG_ISSUE("Error opening file %s - %s", filePath, strerror(errno));
+		return -1;
 	}
 
 	return file;
@@ -252,7 +317,7 @@ size_t load_binary_file(void** data, const char* filePath)
 	int result = fstat(file, &info);
 	if(result < 0)
 	{
-		Log::Add(Log::ISSUE, "Error reading file %s - %s", filePath, strerror(errno));
+		LOG_ISSUE("Error reading file %s - %s", filePath, strerror(errno));
 
 		close(file);
 		return 0;
@@ -264,7 +329,7 @@ size_t load_binary_file(void** data, const char* filePath)
 	ssize_t numReadBytes = read(file, buffer, size);
 	if(numReadBytes < 0)
 	{
-		Log::Add(Log::ISSUE, "Error reading file %s - %s", filePath, strerror(errno));
+		LOG_ISSUE("Error reading file %s - %s", filePath, strerror(errno));
 
 		close(file);
 		return 0;
@@ -283,7 +348,7 @@ void save_binary_file(const void* data, size_t size, const char* filePath, FileW
 	ssize_t bytesWritten = write(file, data, size);
 	if(bytesWritten < 0)
 	{
-		Log::Add(Log::ISSUE, "Could not write to file %s - %s", filePath, strerror(errno));
+		LOG_ISSUE("Could not write to file %s - %s", filePath, strerror(errno));
 	}
 
 	close(file);
@@ -307,7 +372,7 @@ void save_text_file(const char* data, size_t size, const char* filePath, FileWri
 		bytesWritten = write(file, byteOrderMark, 3);
 		if(bytesWritten < 0)
 		{
-			Log::Add(Log::ISSUE, "could not write BOM to file %s - %s", filePath, strerror(errno));
+			LOG_ISSUE("could not write BOM to file %s - %s", filePath, strerror(errno));
 		}
 	}
 
@@ -315,7 +380,7 @@ void save_text_file(const char* data, size_t size, const char* filePath, FileWri
 	bytesWritten = pwrite(file, data, size, 3);
 	if(bytesWritten < 0)
 	{
-		Log::Add(Log::ISSUE, "could not write text to file %s - %s", filePath, strerror(errno));
+		LOG_ISSUE("could not write text to file %s - %s", filePath, strerror(errno));
 	}
 
 	close(file);
@@ -331,12 +396,17 @@ void close_file_stream(file_handle_t stream)
 	close(stream);
 }
 
+bool is_file_stream_open(file_handle_t file)
+{
+	return file >= 0;
+}
+
 size_t read_file_stream(file_handle_t file, unsigned long long readOffset, void* buffer, size_t size)
 {
 	ssize_t numReadBytes = pread(file, buffer, size, readOffset);
 	if(numReadBytes < 0)
 	{
-		Log::Add(Log::ISSUE, "Error reading file stream - %s", strerror(errno));
+		LOG_ISSUE("Error reading file stream - %s", strerror(errno));
 
 		close(file);
 		return 0;
@@ -344,4 +414,51 @@ size_t read_file_stream(file_handle_t file, unsigned long long readOffset, void*
 	return numReadBytes;
 }
 
+unsigned long long file_stream_size(file_handle_t file)
+{
+	struct stat info;
+	if(fstat(file, &info) < 0)
+	{
+		LOG_ISSUE("Error getting file stream size - %s", strerror(errno));
+		return 0;
+	}
+	return info.st_size;
+}
+
+bool map_file(MappedFile* file, const char* filePath)
+{
+	int handle = open_file(filePath, FILE_MODE_READ);
+	if(handle < 0) return false;
+
+	struct stat info;
+	if(fstat(handle, &info) < 0 || info.st_size == 0)
+	{
+		LOG_ISSUE("Error mapping empty or unreadable file %s", filePath);
+
+		close(handle);
+		return false;
+	}
+
+	// the mapping keeps its own reference to the file, so it can be closed now
+	void* data = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, handle, 0);
+	close(handle);
+	if(data == MAP_FAILED)
+	{
+		LOG_ISSUE("Error mapping file %s - %s", filePath, strerror(errno));
+		return false;
+	}
+
+	file->data = data;
+	file->size = info.st_size;
+	return true;
+}
+
+void unmap_file(MappedFile* file)
+{
+	munmap(file->data, file->size);
+
+	file->data = nullptr;
+	file->size = 0;
+}
+
 #endif
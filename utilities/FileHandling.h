@@ -26,6 +26,22 @@ void save_text_file(const char* data, size_t size, const char* filePath, FileWri
 
 file_handle_t open_file_stream(const char* filePath);
 void close_file_stream(file_handle_t file);
+bool is_file_stream_open(file_handle_t file);
 size_t read_file_stream(file_handle_t file, unsigned long long readOffset, void* buffer, size_t size);
+unsigned long long file_stream_size(file_handle_t file); // 0 if it can't be found
+
+// Maps a whole file into memory copy-on-write, so the contents can be changed
+// in place without those changes ever being written back to the file.
+struct MappedFile
+{
+	void* data;
+	size_t size;
+#if defined(_WIN32)
+	void* mapping;
+#endif
+};
+
+bool map_file(MappedFile* file, const char* filePath);
+void unmap_file(MappedFile* file);
 
 #endif
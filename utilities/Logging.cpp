@@ -11,6 +11,8 @@
 #include <Windows.h>
 #endif
 
+#include <mutex>
+
 #include <time.h>
 #include <stdarg.h>
 
@@ -18,22 +20,27 @@
 
 namespace Log
 {
+	// the render, loader and encoder threads all log alongside the main one
+	std::mutex mutex;
 	String stream;
 	long ticks;
 }
 
 void Log::Clear_File()
 {
+	std::lock_guard<std::mutex> lock(mutex);
 	clear_file(LOG_FILE_NAME);
 }
 
 void Log::Inc_Time()
 {
+	std::lock_guard<std::mutex> lock(mutex);
 	ticks++;
 }
 
 void Log::Output(bool printToConsole)
 {
+	std::lock_guard<std::mutex> lock(mutex);
 	if(stream.Size() == 0) return;
 
 	#if defined(_DEBUG)
@@ -73,6 +80,8 @@ static const char* log_level_name(Log::Level level)
 
 void Log::Add(Level level, const char* format, ...)
 {
+	std::lock_guard<std::mutex> lock(mutex);
+
 	// append log header to line
 	stream.Reserve(stream.Size() + 100);
 
@@ -14,7 +14,7 @@ namespace Log
 	void Inc_Time();
 	void Output(bool printToConsole = false);
 	void Add(Level level, const char* format, ...);
-	const char* Get_Text();
+	const char* Get_Text(); // only while no other thread could be logging
 }
 
 #if defined(_DEBUG)
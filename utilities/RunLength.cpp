@@ -0,0 +1,117 @@
+#include "RunLength.h"
+
+#include <cstring>
+
+#define MAX_LITERALS 128
+#define MIN_RUN      3
+#define MAX_RUN      (MIN_RUN + 127)
+
+size_t run_length_bound(size_t size)
+{
+	// worst case is all literals, which costs one control byte per packet
+	return size + (size + MAX_LITERALS - 1) / MAX_LITERALS;
+}
+
+static size_t write_literals(const unsigned char* first, const unsigned char* last, unsigned char* out)
+{
+	size_t count = last - first;
+	if(count == 0) return 0;
+
+	out[0] = static_cast<unsigned char>(count - 1);
+	memcpy(out + 1, first, count);
+	return count + 1;
+}
+
+size_t run_length_encode(const void* input, size_t size, void* output)
+{
+	const unsigned char* in = static_cast<const unsigned char*>(input);
+	unsigned char* out = static_cast<unsigned char*>(output);
+
+	size_t written = 0;
+	size_t literal_start = 0;
+	size_t i = 0;
+	while(i < size)
+	{
+		size_t run = 1;
+		while(i + run < size && run < MAX_RUN && in[i + run] == in[i])
+			++run;
+
+		if(run >= MIN_RUN)
+		{
+			written += write_literals(in + literal_start, in + i, out + written);
+			out[written++] = static_cast<unsigned char>(run - MIN_RUN + MAX_LITERALS);
+			out[written++] = in[i];
+			i += run;
+			literal_start = i;
+		}
+		else
+		{
+			++i;
+			if(i - literal_start == MAX_LITERALS)
+			{
+				written += write_literals(in + literal_start, in + i, out + written);
+				literal_start = i;
+			}
+		}
+	}
+	written += write_literals(in + literal_start, in + size, out + written);
+
+	return written;
+}
+
+size_t run_length_decode(const void* input, size_t size, void* output, size_t capacity)
+{
+	const unsigned char* in = static_cast<const unsigned char*>(input);
+	unsigned char* out = static_cast<unsigned char*>(output);
+
+	size_t read = 0;
+	size_t written = 0;
+	while(read < size)
+	{
+		unsigned char control = in[read++];
+		if(control < MAX_LITERALS)
+		{
+			size_t count = control + 1;
+			if(read + count > size || written + count > capacity) return 0;
+			memcpy(out + written, in + read, count);
+			read += count;
+			written += count;
+		}
+		else
+		{
+			size_t count = control - MAX_LITERALS + MIN_RUN;
+			if(read + 1 > size || written + count > capacity) return 0;
+			memset(out + written, in[read++], count);
+			written += count;
+		}
+	}
+
+	return written;
+}
+
+size_t run_length_decoded_size(const void* input, size_t size)
+{
+	const unsigned char* in = static_cast<const unsigned char*>(input);
+
+	size_t read = 0;
+	size_t decoded = 0;
+	while(read < size)
+	{
+		unsigned char control = in[read++];
+		if(control < MAX_LITERALS)
+		{
+			size_t count = control + 1;
+			if(read + count > size) return 0;
+			read += count;
+			decoded += count;
+		}
+		else
+		{
+			if(read + 1 > size) return 0;
+			read += 1;
+			decoded += control - MAX_LITERALS + MIN_RUN;
+		}
+	}
+
+	return decoded;
+}
\ No newline at end of file
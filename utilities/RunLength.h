@@ -0,0 +1,21 @@
+#ifndef RUN_LENGTH_H
+#define RUN_LENGTH_H
+
+#include <cstddef>
+
+// Byte-oriented run-length coding in the style of PackBits. Each packet starts
+// with a control byte: below 128 it's followed by (control + 1) literal bytes,
+// otherwise by one byte which is repeated (control - 125) times.
+
+size_t run_length_bound(size_t size);
+size_t run_length_encode(const void* input, size_t size, void* output);
+
+// returns the number of bytes decoded, or zero if the input was malformed or
+// wouldn't fit in the output
+size_t run_length_decode(const void* input, size_t size, void* output, size_t capacity);
+
+// returns how many bytes the input would decode to without decoding it, or
+// zero if it's malformed, so the output can be checked before it's allocated
+size_t run_length_decoded_size(const void* input, size_t size);
+
+#endif
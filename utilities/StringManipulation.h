@@ -1,10 +1,21 @@
 #ifndef STRING_MANIPULATION_H
 #define STRING_MANIPULATION_H
 
+#include <cstddef>
+
 static inline void concatenate(const char* input_a, const char* input_b, char* output)
 {
 	while((*output = *input_a++)) ++output;
 	while((*output++ = *input_b++));
 }
 
+// copies as much of the input as fits, always leaving the output terminated
+static inline void copy_string(const char* input, char* output, size_t capacity)
+{
+	if(capacity == 0) return;
+	char* last = output + capacity - 1;
+	while(output < last && (*output = *input++)) ++output;
+	*output = '\0';
+}
+
 #endif
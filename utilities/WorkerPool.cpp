@@ -0,0 +1,152 @@
+#include "WorkerPool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+struct WorkerPool
+{
+	std::thread* threads;
+	int thread_count;
+
+	std::mutex mutex;
+	std::condition_variable work_ready;
+	std::condition_variable work_done;
+
+	// the current batch, replaced each time the generation number goes up
+	JobFunction function;
+	void* data;
+	unsigned generation;
+	bool quit;
+
+	// A batch isn't over until every worker that joined it has stopped
+	// looking for jobs, or one that's late could take a job from the next.
+	int busy_workers;
+
+	std::atomic<int> job_count;
+	std::atomic<int> next_job;
+	std::atomic<int> jobs_remaining;
+};
+
+static void do_jobs(WorkerPool* pool)
+{
+	for(;;)
+	{
+		int job = pool->next_job.fetch_add(1);
+		if(job >= pool->job_count) break;
+
+		pool->function(job, pool->data);
+
+		if(pool->jobs_remaining.fetch_sub(1) == 1)
+		{
+			std::lock_guard<std::mutex> lock(pool->mutex);
+			pool->work_done.notify_all();
+		}
+	}
+}
+
+static void worker_main(WorkerPool* pool)
+{
+	unsigned seen_generation = 0;
+	for(;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(pool->mutex);
+			while(!pool->quit && pool->generation == seen_generation)
+				pool->work_ready.wait(lock);
+
+			if(pool->quit) return;
+			seen_generation = pool->generation;
+			pool->busy_workers += 1;
+		}
+
+		do_jobs(pool);
+
+		{
+			std::lock_guard<std::mutex> lock(pool->mutex);
+			pool->busy_workers -= 1;
+		}
+		pool->work_done.notify_all();
+	}
+}
+
+WorkerPool* create_worker_pool(int thread_count)
+{
+	if(thread_count < 1) thread_count = 1;
+
+	WorkerPool* pool = new WorkerPool;
+	pool->function = nullptr;
+	pool->data = nullptr;
+	pool->job_count = 0;
+	pool->generation = 0;
+	pool->quit = false;
+	pool->busy_workers = 0;
+	pool->next_job = 0;
+	pool->jobs_remaining = 0;
+
+	// the calling thread counts as one of the workers
+	pool->thread_count = thread_count;
+	pool->threads = new std::thread[thread_count - 1];
+	for(int i = 0; i < thread_count - 1; ++i)
+		pool->threads[i] = std::thread(worker_main, pool);
+
+	return pool;
+}
+
+void destroy_worker_pool(WorkerPool* pool)
+{
+	if(pool == nullptr) return;
+
+	{
+		std::lock_guard<std::mutex> lock(pool->mutex);
+		pool->quit = true;
+	}
+	pool->work_ready.notify_all();
+
+	for(int i = 0; i < pool->thread_count - 1; ++i)
+		pool->threads[i].join();
+
+	delete[] pool->threads;
+	delete pool;
+}
+
+void run_jobs(WorkerPool* pool, JobFunction function, void* data, int job_count)
+{
+	if(job_count <= 0) return;
+
+	if(pool->thread_count == 1 || job_count == 1)
+	{
+		for(int i = 0; i < job_count; ++i)
+			function(i, data);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(pool->mutex);
+		pool->function = function;
+		pool->data = data;
+		pool->job_count = job_count;
+		pool->next_job = 0;
+		pool->jobs_remaining = job_count;
+		++pool->generation;
+	}
+	pool->work_ready.notify_all();
+
+	do_jobs(pool);
+
+	std::unique_lock<std::mutex> lock(pool->mutex);
+	while(pool->jobs_remaining.load() > 0 || pool->busy_workers > 0)
+		pool->work_done.wait(lock);
+}
+
+int worker_pool_thread_count(const WorkerPool* pool)
+{
+	return pool->thread_count;
+}
+
+int processor_count()
+{
+	int count = std::thread::hardware_concurrency();
+	return (count > 0) ? count : 1;
+}
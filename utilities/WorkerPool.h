@@ -0,0 +1,20 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+// A fixed set of threads that split a batch of numbered jobs between them.
+// The thread that calls run_jobs works on the batch too and only returns once
+// every job in it has finished, so a pool of one thread spawns no threads.
+
+typedef void (*JobFunction)(int job_index, void* data);
+
+struct WorkerPool;
+
+WorkerPool* create_worker_pool(int thread_count);
+void destroy_worker_pool(WorkerPool* pool);
+
+void run_jobs(WorkerPool* pool, JobFunction function, void* data, int job_count);
+int worker_pool_thread_count(const WorkerPool* pool);
+
+int processor_count();
+
+#endif